@@ -10,6 +10,7 @@ greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
 TARGET = FSCT_GUI
 TEMPLATE = app
+CONFIG += c++11
 
 CONFIG(debug, debug|release) {
     DESTDIR =       $$PWD/debug
@@ -29,14 +30,29 @@ CONFIG(release, debug|release) {
 
 SOURCES += main.cpp\
         widget.cpp \
+        trackworker.cpp \
         corrtrack.cpp \
+        stagetimer.cpp \
+        alloccount.cpp \
+        framesource.cpp \
+        multitrack.cpp \
         hog.c \
-        lpt.c
+        lpt.c \
+        fft.c \
+        resample.c
 
 HEADERS  += widget.h \
+        trackworker.h \
+        spscqueue.h \
         corrtrack.h \
+        stagetimer.h \
+        alloccount.h \
+        framesource.h \
+        multitrack.h \
         hog.h \
-        lpt.h
+        lpt.h \
+        fft.h \
+        resample.h
 
 FORMS    += widget.ui
 
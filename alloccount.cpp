@@ -0,0 +1,82 @@
+#include <opencv2/core.hpp>
+
+#include "alloccount.h"
+
+using namespace cv;
+
+#if CV_VERSION_MAJOR >= 4
+typedef AccessFlag AllocAccessFlag;
+#else
+typedef int AllocAccessFlag;
+#endif
+
+#if defined(_MSC_VER) && _MSC_VER < 1900
+#define ALLOC_THREAD_LOCAL __declspec(thread)
+#else
+#define ALLOC_THREAD_LOCAL thread_local
+#endif
+
+/* 当前线程分配的Mat是否不计入, 见setAllocCountIgnored */
+static ALLOC_THREAD_LOCAL bool allocIgnored = false;
+
+/*
+ * 统计分配次数的Mat分配器. 分配结果的currAllocator为标准分配器,
+ * 因此释放时不再经过本分配器
+ */
+class CountingAllocator : public MatAllocator
+{
+public:
+    CountingAllocator() : count(0) {}
+
+    virtual UMatData* allocate(int dims, const int* sizes, int type, void* data, size_t* step,
+                               AllocAccessFlag flags, UMatUsageFlags usageFlags) const
+    {
+        if(data == NULL && !allocIgnored)
+            CV_XADD(&count, 1);
+        return Mat::getStdAllocator()->allocate(dims, sizes, type, data, step, flags, usageFlags);
+    }
+
+    virtual bool allocate(UMatData* data, AllocAccessFlag accessFlags, UMatUsageFlags usageFlags) const
+    {
+        return Mat::getStdAllocator()->allocate(data, accessFlags, usageFlags);
+    }
+
+    virtual void deallocate(UMatData* data) const
+    {
+        Mat::getStdAllocator()->deallocate(data);
+    }
+
+    mutable int count;
+};
+
+static CountingAllocator allocCounter;
+static bool allocCounterInstalled = false;
+
+/**
+ * @brief 将计数分配器设为OpenCV的默认Mat分配器, 重复调用无副作用
+ */
+void installAllocCounter()
+{
+    if(allocCounterInstalled)
+        return;
+    Mat::setDefaultAllocator(&allocCounter);
+    allocCounterInstalled = true;
+}
+
+/**
+ * @brief 获取安装计数分配器以来新分配的Mat缓存数, 未安装时为0
+ * @return
+ */
+int getAllocCount()
+{
+    return CV_XADD(&allocCounter.count, 0);
+}
+
+/**
+ * @brief 设置当前线程分配的Mat是否不计入计数, 用于与跟踪无关的后台线程
+ * @param ignore
+ */
+void setAllocCountIgnored(bool ignore)
+{
+    allocIgnored = ignore;
+}
@@ -0,0 +1,20 @@
+#ifndef ALLOCCOUNT_H
+#define ALLOCCOUNT_H
+
+/*
+ * Mat内存分配计数, 用于验证跟踪过程中没有重新分配内存.
+ * installAllocCounter把一个计数的MatAllocator设为OpenCV的默认分配器, 实际的
+ * 分配与释放仍由标准分配器完成, 此后每次新分配Mat缓存计数加1.
+ * 计数是进程全局的, 检查期间其他线程分配的Mat也会计入, 与跟踪无关的线程
+ * (如FrameSource的解码线程)应调用setAllocCountIgnored将自身排除;
+ * 只统计cv::Mat的缓存, C内核(hog.c等)内部的malloc与OpenCV函数内部的临时缓冲不在其中.
+ * 分配器安装后不再卸载, 只比原来多一次原子加法. installAllocCounter须在开始跟踪前调用.
+ */
+
+void installAllocCounter();
+
+int getAllocCount();
+
+void setAllocCountIgnored(bool ignore);
+
+#endif // ALLOCCOUNT_H
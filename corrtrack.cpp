@@ -4,8 +4,10 @@
 #include <string>
 #include <vector>
 #include <string>
+#ifdef _WIN32
 #include <direct.h>
 #include <io.h>
+#endif
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -16,10 +18,17 @@
 #include <opencv2/videoio.hpp>
 
 #include "corrtrack.h"
+#include "alloccount.h"
 
 using namespace std;
 using namespace cv;
 
+#ifdef _WIN32
+#define PATH_SEP '\\'
+#else
+#define PATH_SEP '/'
+#endif
+
 static const float DIV255 = 0.0039215f;
 static cv::Point _LEFTUP;       //左上角点
 static cv::Point _RIGHTDOWN;    //右下角点
@@ -45,24 +54,257 @@ static void onMouse(int mouseEvent, int x, int y, int, void*)
     return;
 }
 
+/**
+ * @brief 为YUV帧的亮度建立Mat头, 不拷贝数据, 也不做颜色转换.
+ * NV12与I420的Y平面即为灰度图像, 色度平面不会被读取;
+ * YUYV表示为2通道图像, 亮度位于第0通道, 采样时按2字节步长读取
+ */
+static Mat wrapLuma(const uchar *yuv, int width, int height, int stride, int format)
+{
+    CV_Assert(yuv != NULL && (format == YUV_NV12 || format == YUV_I420 || format == YUV_YUYV));
+    if(format == YUV_YUYV)
+        return Mat(height, width, CV_8UC2, (void*)yuv, stride);
+    return Mat(height, width, CV_8UC1, (void*)yuv, stride);
+}
+
+/**
+ * @brief 平移与尺度两个分支的并行训练任务, stripe 0为平移分支, stripe 1为尺度分支.
+ * 两个分支各自使用独立的HOG描述子, FFT_Plan与CorrWorkspace, 只读共享当前帧
+ * 与目标区域, 不共享任何可写状态
+ */
+class CorrBranchBody : public ParallelLoopBody
+{
+public:
+    CorrBranchBody(CorrTrack *tracker, Mat *frame, float transDx, float transDy, float scale, float scaleDx)
+        : tracker(tracker), frame(frame), transDx(transDx), transDy(transDy), scale(scale), scaleDx(scaleDx) {}
+    virtual void operator()(const Range &range) const
+    {
+        for(int i = range.start; i < range.end; i++)
+        {
+            if(i == 0)
+                tracker->updateTrans(*frame, transDx, transDy, scale);
+            else
+                tracker->updateScale(*frame, scaleDx);
+        }
+    }
+private:
+    CorrTrack *tracker;
+    Mat *frame;
+    float transDx;
+    float transDy;
+    float scale;
+    float scaleDx;
+};
+
+/**
+ * @brief HOG并行任务的执行体, stripe i执行task(arg, i)
+ */
+class HogTaskBody : public ParallelLoopBody
+{
+public:
+    HogTaskBody(HogTask task, void *arg) : task(task), arg(arg) {}
+    virtual void operator()(const Range &range) const
+    {
+        for(int i = range.start; i < range.end; i++)
+            task(arg, i);
+    }
+private:
+    HogTask task;
+    void *arg;
+};
+
+/**
+ * @brief 以OpenCV的线程池实现hog.c的并行接口, 与分支并行训练共用同一线程池,
+ * pool参数不使用. 在并行的分支中调用时OpenCV按串行执行, 不会嵌套创建线程
+ */
+void cvHogParallelFor(void *pool, int count, HogTask task, void *arg)
+{
+    parallel_for_(Range(0, count), HogTaskBody(task, arg), count);
+}
+
 CorrTrack::CorrTrack()
 {
+    useScale = true;
+    transHog = NULL;
+    scaleHog = NULL;
+    scaleLpt = NULL;
+    transWs.fft = NULL;
+    scaleWs.fft = NULL;
+    sampleScratch.pos = NULL;
+    sampleScratch.weight = NULL;
+    sampleScratch.capacity = 0;
+    allocCheck = false;
+    snapshotCount = 0;
+    dumpProfile = false;
+    if(getenv("FSCT_PROFILE"))
+        setProfiling(true, true);
     initParam();
 }
 
 CorrTrack::CorrTrack(TrackParam *param)
 {
+    transHog = NULL;
+    scaleHog = NULL;
+    scaleLpt = NULL;
+    transWs.fft = NULL;
+    scaleWs.fft = NULL;
+    sampleScratch.pos = NULL;
+    sampleScratch.weight = NULL;
+    sampleScratch.capacity = 0;
+    allocCheck = false;
+    snapshotCount = 0;
+    dumpProfile = false;
+    if(getenv("FSCT_PROFILE"))
+        setProfiling(true, true);
     initParam(param);
 }
 
 CorrTrack::~CorrTrack()
 {
-    freeHogDescriptor(transHog);
-    if(useScale)
+    if(dumpProfile)
+        profiler.dump(stderr, "CorrTrack stage timing (per frame)");
+    releaseDescriptors();
+    freeResampleScratch(&sampleScratch);
+}
+
+void CorrTrack::releaseDescriptors()
+{
+    if(transHog)
+    {
+        freeHogDescriptor(transHog);
+        transHog = NULL;
+    }
+    if(scaleHog)
     {
         freeHogDescriptor(scaleHog);
+        scaleHog = NULL;
+    }
+    if(scaleLpt)
+    {
         freeLptGrid(scaleLpt);
+        scaleLpt = NULL;
+    }
+    if(transWs.fft)
+    {
+        freeFftPlan(transWs.fft);
+        transWs.fft = NULL;
+    }
+    if(scaleWs.fft)
+    {
+        freeFftPlan(scaleWs.fft);
+        scaleWs.fft = NULL;
+    }
+}
+
+/**
+ * @brief 按分支的模板尺寸一次性分配工作空间中的全部矩阵
+ * @param ws 工作空间, 其中的FFT_Plan须已建立
+ * @param pattSz 模板尺寸(特征图的宽与高)
+ * @param channels 特征通道数
+ */
+void CorrTrack::initWorkspace(CorrWorkspace *ws, int pattSz, int channels)
+{
+    assert(ws->fft != NULL);
+    int specCols = useHalfSpectrum ? getFftHalfWidth(ws->fft) : pattSz;
+    int sz[3] = {channels, pattSz, specCols};
+    ws->featF.create(3, sz, CV_32FC2);
+    ws->xyf.create(pattSz, specCols, CV_32FC2);
+    ws->xy.create(pattSz, pattSz, CV_32F);
+    ws->kernelF.create(pattSz, specCols, CV_32FC2);
+    ws->responseF.create(pattSz, specCols, CV_32FC2);
+    ws->response.create(pattSz, pattSz, CV_32F);
+    ws->alphaF.create(pattSz, specCols, CV_32FC2);
+}
+
+/**
+ * @brief 开启或关闭工作空间检查. 开启后, 第一帧跟踪结束时记录全部缓存的
+ * 数据地址, 之后每一帧结束时断言这些地址保持不变, 并且该帧内没有新分配
+ * 任何Mat缓存(由计数分配器统计, 见alloccount.h), 即跟踪过程中没有重新分配内存.
+ * 计数是进程全局的, 检查期间不能有其他线程分配Mat
+ * @param enable
+ */
+void CorrTrack::setAllocCheck(bool enable)
+{
+    if(enable)
+        installAllocCounter();
+    allocCheck = enable;
+    snapshotCount = 0;
+}
+
+/**
+ * @brief 开启或关闭分阶段计时, 开启时清空已有的统计结果
+ * @param enable
+ * @param dumpAtExit 为true时, 跟踪器析构时将统计结果输出到stderr.
+ * 设置了环境变量FSCT_PROFILE时, 跟踪器在构造时即开启计时并在析构时输出
+ */
+void CorrTrack::setProfiling(bool enable, bool dumpAtExit)
+{
+    if(enable && !profiler.isEnabled())
+        profiler.reset();
+    profiler.setEnabled(enable);
+    dumpProfile = enable && dumpAtExit;
+}
+
+/**
+ * @brief 获取分阶段计时的统计结果, 见StageProfiler::getStats
+ * @return
+ */
+const StageProfiler& CorrTrack::getProfiler() const
+{
+    return profiler;
+}
+
+/**
+ * @brief 收集跟踪过程中读写的全部缓存的数据地址
+ * @param data 输出的地址列表, 长度不小于CORR_SNAPSHOT_MAX
+ * @return 地址个数
+ */
+int CorrTrack::getWorkspaceData(const uchar **data)
+{
+    int n = 0;
+    CorrWorkspace *ws[2] = {&transWs, &scaleWs};
+    for(int i = 0; i < 2; i++)
+    {
+        data[n++] = ws[i]->featF.data;
+        data[n++] = ws[i]->xyf.data;
+        data[n++] = ws[i]->xy.data;
+        data[n++] = ws[i]->kernelF.data;
+        data[n++] = ws[i]->responseF.data;
+        data[n++] = ws[i]->response.data;
+        data[n++] = ws[i]->alphaF.data;
     }
+    data[n++] = transPatch.data;
+    data[n++] = scalePatch.data;
+    data[n++] = transFeat.data;
+    data[n++] = scaleFeat.data;
+    data[n++] = transModelF.data;
+    data[n++] = transAlphaF.data;
+    data[n++] = scaleModelF.data;
+    data[n++] = scaleAlphaF.data;
+    data[n++] = globalApp.data;
+    data[n++] = globalAppF.data;
+    data[n++] = currentApp.data;
+    assert(n <= CORR_SNAPSHOT_MAX);
+    return n;
+}
+
+/**
+ * @brief 一帧跟踪结束时检查工作空间, 见setAllocCheck. 第一帧只记录缓存地址
+ * @param allocs 该帧内新分配的Mat缓存数
+ */
+void CorrTrack::checkWorkspace(int allocs)
+{
+    if(snapshotCount == 0)
+    {
+        snapshotCount = getWorkspaceData(snapshot);
+        return;
+    }
+    CV_Assert(allocs == 0);
+    const uchar *current[CORR_SNAPSHOT_MAX];
+    int n = getWorkspaceData(current);
+    CV_Assert(n == snapshotCount);
+    for(int i = 0; i < n; i++)
+        CV_Assert(current[i] == snapshot[i]);
 }
 
 void CorrTrack::initParam()
@@ -76,6 +318,13 @@ void CorrTrack::initParam()
     transPattSz = 32;    
     transLearnRate = 0.02;
     transSigmaCoef = 1.0/26;
+    useHalfSpectrum = false;
+    reuseFeatures = false;
+    reuseMaxShift = 2;
+    reuseScaleTol = 0.02;
+    sampleMethod = RS_BILINEAR;
+    parallelBranches = false;
+    parallelHog = false;
     if(useScale)
     {
         scaleCellSz = 4;
@@ -97,7 +346,15 @@ void CorrTrack::initParam(TrackParam *param)
     transPattSz = param->transPattSz;
     transLearnRate = param->transLearnRate;
     transSigmaCoef = 1.0 / param->transGaussSigmaRate;
-    if(useScale = param->useScale)
+    useHalfSpectrum = param->useHalfSpectrum;
+    reuseFeatures = param->reuseFeatures;
+    reuseMaxShift = 2;
+    reuseScaleTol = 0.02;
+    sampleMethod = param->sampleMethod;
+    parallelBranches = param->parallelBranches;
+    parallelHog = param->parallelHog;
+    useScale = param->useScale;
+    if(useScale)
     {
         scaleCellSz = param->scaleCellSz;
         scalePattSz = param->scalePattSz;
@@ -109,16 +366,14 @@ void CorrTrack::initParam(TrackParam *param)
 
 void CorrTrack::initCamera(int deviceId)
 {
-    video.open(deviceId);
-    if(!video.isOpened())
+    if(!source.openCamera(deviceId, FRAME_POLICY_LATEST))
         perror("无法初始化摄像头, 请确认该设备已正确安装!\n");
     return;
 }
 
 void CorrTrack::initVideo(const string videoName)
 {
-    video.open(videoName);
-    if(!video.isOpened())
+    if(!source.openVideo(videoName, FRAME_POLICY_BLOCK))
         perror("无法播放该视频, 请确认解码库已正确安装!\n");
     return;
 }
@@ -147,10 +402,13 @@ void CorrTrack::trackFromSequence(const string datasetPath)
 {
     readGroundTruth(datasetPath);
     string picSeqPath = datasetPath;
-    if(picSeqPath[picSeqPath.length()-1] != '\\')
-        picSeqPath += '\\';
-    picSeqPath += "img\\";
+    if(picSeqPath[picSeqPath.length()-1] != PATH_SEP)
+        picSeqPath += PATH_SEP;
+    picSeqPath += "img";
+    picSeqPath += PATH_SEP;
     listPicFiles(picSeqPath);
+    if(!source.openSequence(picSeq))
+        perror("无法读取图像序列, 请确认路径正确!\n");
     initParam();
     sourceType = FROM_IMAGESEQUENCE;
     initFristFrame();
@@ -160,29 +418,25 @@ void CorrTrack::trackFromSequence(const string datasetPath)
 
 void CorrTrack::fillFrameBuf()
 {
-    if (sourceType == FROM_CAMERA || sourceType == FROM_VIDEO)
-    {
-        video >> frameBuf;
-        frameNum++;
-    }
-    else
+    if(sourceType == FROM_IMAGESEQUENCE && (frameNum >= (int)picSeq.size()-1 || frameNum >= (int)groundTruth.size()-1))
     {
-        if(frameNum >= picSeq.size()-1 || frameNum >= groundTruth.size()-1)
-            frameBuf.deallocate();
-        else
-            frameBuf = imread(picSeq[frameNum++]);
+        frameBuf.release();
+        return;
     }
+    //帧数据属于source的帧缓存, 下一次取帧时归还, 不做拷贝
+    source.acquire(frameBuf);
+    frameNum++;
 }
 
 void CorrTrack::initFristFrame()
 {
-    Mat I;
     namedWindow(windowName);
     if(sourceType == FROM_CAMERA || sourceType == FROM_VIDEO)
     {
         while(1)
         {
-            video >> frameBuf;
+            if(!source.acquire(frameBuf))
+                break;
             string text("Press Enter to stop, draw rectangle on target, then press Enter...");
             putText(frameBuf, text, Point(5, 40), FONT_HERSHEY_PLAIN, 1, Scalar(0,0,255), 1);
             imshow(windowName, frameBuf);
@@ -193,54 +447,15 @@ void CorrTrack::initFristFrame()
     }
     else
     {
-        frameBuf = imread(picSeq[frameNum++]);
+        source.acquire(frameBuf);
+        frameNum++;
         imshow(windowName, frameBuf);
     }
-    if(frameBuf.channels() == 3)
-        cvtColor(frameBuf, I, CV_BGR2GRAY);
-    else
-        frameBuf.copyTo(I);
     if(sourceType == FROM_CAMERA || sourceType == FROM_VIDEO)
-        mouseSelect(windowName.c_str(), I, tgtRect);
+        mouseSelect(windowName.c_str(), frameBuf, tgtRect);
     else
         tgtRect = groundTruth[frameNum];
-    Rect2C(tgtRect, &tgtBox);
-    winBox.x = tgtBox.x;
-    winBox.y = tgtBox.y;
-    winBox.width = floor(1.0 * tgtBox.width * (padding + 1));
-    winBox.height = floor(1.0 * tgtBox.height * (padding + 1));
-    xZoom = 1.0 * (winBox.width - 1) / (transPattSz - 1);
-    yZoom = 1.0 * (winBox.height - 1) / (transPattSz - 1);
-    transPatchNormSz = transPattSz * transCellSz;
-    transHog = newHogDescriptor(transCellSz, 9, 0, 0);
-    Size patSz(transPattSz, transPattSz);
-    getHannWindow(transHannWin, patSz);
-    getGaussLabelF(transGaussLabelF, patSz, transSigmaCoef * transPattSz);
-    getPatch(I, winPatch, &winBox);
-    resize(winPatch, transPatch, Size(transPatchNormSz, transPatchNormSz));
-    getFeatures(transPatch, transFeat, transHannWin, transHog);
-    fft2(transFeat, transModelF);
-    train(transModelF, transGaussLabelF, transAlphaF, gaussCorrSigma, lambda);
-
-    if(useScale)
-    {
-        scalePatchNormSz = scaleCellSz * scalePattSz;
-        rhoMax = log(std::sqrt(2.0) * 0.5 * scalePattSz);
-        rhoMin = log(0.5 * scalePattSz * rhoMinRate);
-        scaleHog = newHogDescriptor(scaleCellSz, 9, 0, 0);
-        scaleLpt = newLptGrid(scalePatchNormSz, scalePatchNormSz,
-                              scalePatchNormSz, scalePatchNormSz, rhoMinRate);
-        lptPatch.create(scalePatchNormSz, scalePatchNormSz, CV_8U);
-        Size patSz(scalePattSz, scalePattSz);
-        getHannWindow(scaleHannWin, patSz);
-        getGaussLabelF(scaleGaussLabelF, patSz, scalePattSz * scaleSigmaCoef);
-        getPatch(I, tgtPatch, &tgtBox);
-        resize(tgtPatch, lptPatch, Size(scalePatchNormSz, scalePatchNormSz));
-        logPolarTransform(lptPatch, scalePatch, scaleLpt);
-        getFeatures(scalePatch, scaleFeat, scaleHannWin, scaleHog);
-        fft2(scaleFeat, scaleModelF);
-        train(scaleModelF, scaleGaussLabelF, scaleAlphaF, gaussCorrSigma, lambda);
-    }
+    initTarget(frameBuf, tgtRect);
     rectangle(frameBuf, tgtRect, Scalar(0,0,255), 2);
     imshow(windowName, frameBuf);
     waitKey(5);
@@ -249,11 +464,10 @@ void CorrTrack::initFristFrame()
 
 void CorrTrack::initTarget(Mat &frameBuf, Rect &tgtRect)
 {
-    Mat I;
-    if(frameBuf.channels() == 3)
-        cvtColor(frameBuf, I, CV_BGR2GRAY);
-    else
-        frameBuf.copyTo(I);
+    //BGR图像不做整帧灰度转换, 采样时只转换用到的像素; 2通道图像为YUYV
+    assert(frameBuf.type() == CV_8UC1 || frameBuf.type() == CV_8UC2 || frameBuf.type() == CV_8UC3);
+    releaseDescriptors();
+    snapshotCount = 0;
     Rect2C(tgtRect, &tgtBox);
     winBox.x = tgtBox.x;
     winBox.y = tgtBox.y;
@@ -262,121 +476,199 @@ void CorrTrack::initTarget(Mat &frameBuf, Rect &tgtRect)
     xZoom = 1.0 * (winBox.width - 1) / (transPattSz - 1);
     yZoom = 1.0 * (winBox.height - 1) / (transPattSz - 1);
     transPatchNormSz = transPattSz * transCellSz;
-    transHog = newHogDescriptor(transCellSz, 9, 0, 0);
+    transHog = newHogDescriptor(transCellSz, 9, 0, 0, 0);
+    if(parallelHog)
+        setHogParallel(transHog, cvHogParallelFor, NULL, getNumThreads());
+    transWs.fft = newFftPlan(transPattSz, transPattSz);
+    initWorkspace(&transWs, transPattSz, getHogFeatureChannels(transHog));
     Size patSz(transPattSz, transPattSz);
     getHannWindow(transHannWin, patSz);
     getGaussLabelF(transGaussLabelF, patSz, transSigmaCoef * transPattSz);
-    getPatch(I, winPatch, &winBox);
-    resize(winPatch, transPatch, Size(transPatchNormSz, transPatchNormSz));
+    transPatch.create(transPatchNormSz, transPatchNormSz, CV_8U);
+    reserveResampleScratch(&sampleScratch, frameBuf.cols, transPatchNormSz);
+    samplePatch(frameBuf, &winBox, transPatch);
     getFeatures(transPatch, transFeat, transHannWin, transHog);
-    fft2(transFeat, transModelF);
-    train(transModelF, transGaussLabelF, transAlphaF, gaussCorrSigma, lambda);
+    fft2(transFeat, transModelF, transWs.fft);
+    train(transModelF, transGaussLabelF, transAlphaF, gaussCorrSigma, lambda, &transWs);
     if(useScale)
     {
         scalePatchNormSz = scaleCellSz * scalePattSz;
         rhoMax = log(std::sqrt(2.0) * 0.5 * scalePattSz);
         rhoMin = log(0.5 * scalePattSz * rhoMinRate);
-        scaleHog = newHogDescriptor(scaleCellSz, 9, 0, 0);
+        scaleHog = newHogDescriptor(scaleCellSz, 9, 0, 0, 0);
+        if(parallelHog)
+            setHogParallel(scaleHog, cvHogParallelFor, NULL, getNumThreads());
+        scaleWs.fft = newFftPlan(scalePattSz, scalePattSz);
+        initWorkspace(&scaleWs, scalePattSz, getHogFeatureChannels(scaleHog));
         scaleLpt = newLptGrid(scalePatchNormSz, scalePatchNormSz,
                               scalePatchNormSz, scalePatchNormSz, rhoMinRate);
-        lptPatch.create(scalePatchNormSz, scalePatchNormSz, CV_8U);
         Size patSz(scalePattSz, scalePattSz);
         getHannWindow(scaleHannWin, patSz);
         getGaussLabelF(scaleGaussLabelF, patSz, scalePattSz * scaleSigmaCoef);
-        getPatch(I, tgtPatch, &tgtBox);
-        resize(tgtPatch, lptPatch, Size(scalePatchNormSz, scalePatchNormSz));
-        logPolarTransform(lptPatch, scalePatch, scaleLpt);
+        logPolarTransform(frameBuf, &tgtBox, scalePatch, scaleLpt);
         getFeatures(scalePatch, scaleFeat, scaleHannWin, scaleHog);
-        fft2(scaleFeat, scaleModelF);
-        train(scaleModelF, scaleGaussLabelF, scaleAlphaF, gaussCorrSigma, lambda);
+        fft2(scaleFeat, scaleModelF, scaleWs.fft);
+        train(scaleModelF, scaleGaussLabelF, scaleAlphaF, gaussCorrSigma, lambda, &scaleWs);
     }
     transPatch.copyTo(globalApp);
+    transPatch.copyTo(currentApp);
+    globalAppF.create(transPatch.rows, transPatch.cols, CV_32F);
+    profiler.discardFrame(); //初始化不计入逐帧统计
 }
 
 void CorrTrack::trackEachFrame(Mat &frameBuf, Rect &outRect)
 {
-    Mat I;
     cRectp rp = {0, 0, 0, 0};
     if(frameBuf.empty())
         return;
-    if(frameBuf.channels() == 3)
-        cvtColor(frameBuf, I, CV_BGR2GRAY);
-    else
-        frameBuf.copyTo(I);
-    getPatch(I, winPatch, &winBox);
-    resize(winPatch, transPatch, Size(transPatchNormSz, transPatchNormSz));
+    assert(frameBuf.type() == CV_8UC1 || frameBuf.type() == CV_8UC2 || frameBuf.type() == CV_8UC3);
+    int64 frameStart = profiler.isEnabled() ? getTickCount() : 0;
+    int allocStart = allocCheck ? getAllocCount() : 0;
+    samplePatch(frameBuf, &winBox, transPatch);
     getFeatures(transPatch, transFeat, transHannWin, transHog);
-    Mat transXF, transResponse;
     Point2f resPos;
-    fft2(transFeat, transXF);
-    detect(transXF, transModelF, transAlphaF, transResponse, resPos, gaussCorrSigma);
+    fft2(transFeat, transWs.featF, transWs.fft);
+    detect(transWs.featF, transModelF, transAlphaF, resPos, gaussCorrSigma, &transWs);
+    float scale = 1.0f;
+    float scaleDx = 0;
+    int oldWinX = winBox.x;
+    int oldWinY = winBox.y;
+    int oldTgtWidth = tgtBox.width;
 
     RectC2P(&winBox, &rp);
     winBox.x = floor((resPos.x) * xZoom + rp.ltx);
     winBox.y = floor((resPos.y) * yZoom + rp.lty);
     tgtBox.x = winBox.x;
     tgtBox.y = winBox.y;
+    //训练窗口相对检测窗口的实际位移(特征单元), 包括窗口中心取整的部分
+    float transDx = (winBox.x - oldWinX) / xZoom;
+    float transDy = (winBox.y - oldWinY) / yZoom;
 
     if(useScale)
     {
-        getPatch(I, tgtPatch, &tgtBox);
-        resize(tgtPatch, lptPatch, Size(scalePatchNormSz, scalePatchNormSz));
-        logPolarTransform(lptPatch, scalePatch, scaleLpt);
+        logPolarTransform(frameBuf, &tgtBox, scalePatch, scaleLpt);
         getFeatures(scalePatch, scaleFeat, scaleHannWin, scaleHog);
-        Mat scaleXF, scaleResponse;
-        float scale;
-        fft2(scaleFeat, scaleXF);
-        detect(scaleXF, scaleModelF, scaleAlphaF, scaleResponse, resPos, gaussCorrSigma);
+        fft2(scaleFeat, scaleWs.featF, scaleWs.fft);
+        detect(scaleWs.featF, scaleModelF, scaleAlphaF, resPos, gaussCorrSigma, &scaleWs);
         scale = exp(-log(rhoMinRate) * (resPos.x - (scalePattSz - 1) * 0.5) / scalePattSz);
         tgtBox.width = cvRound(1.0 * tgtBox.width * scale);
         tgtBox.height = cvRound(1.0 * tgtBox.height * scale);
+        //按取整后的实际尺度变化换算rho方向的位移(特征单元)
+        scaleDx = log(1.0 * tgtBox.width / oldTgtWidth) * scalePattSz / -log(rhoMinRate);
         winBox.width = cvRound(1.0 * tgtBox.width * (padding + 1));
         winBox.height = cvRound(1.0 * tgtBox.height * (padding + 1));
         xZoom = 1.0 * (winBox.width - 1) / (transPattSz - 1);
         yZoom = 1.0 * (winBox.height - 1) / (transPattSz - 1);
     }
 
-    getPatch(I, winPatch, &winBox);
-    resize(winPatch, transPatch, Size(transPatchNormSz, transPatchNormSz));
-    getFeatures(transPatch, transFeat, transHannWin, transHog);
-    Mat transModelF_new, transAlphaF_new;
-    fft2(transFeat, transModelF_new);
-    train(transModelF_new, transGaussLabelF, transAlphaF_new, gaussCorrSigma, lambda);
-    accumulateWeighted(transModelF_new, transModelF, transLearnRate);
-    accumulateWeighted(transAlphaF_new, transAlphaF, transLearnRate);
-    Mat tmp;
-    globalApp.convertTo(tmp, CV_32F);
-    accumulateWeighted(transPatch, tmp, transLearnRate);
-    tmp.convertTo(globalApp, CV_8U);
-    transPatch.copyTo(currentApp);
-
-    if(useScale)
+    //两个分支的训练只依赖更新后的目标位置与尺寸, 彼此独立
+    if(parallelBranches && useScale)
     {
-        getPatch(I, tgtPatch, &tgtBox);
-        resize(tgtPatch, lptPatch, Size(scalePatchNormSz, scalePatchNormSz));
-        logPolarTransform(lptPatch, scalePatch, scaleLpt);
-        getFeatures(scalePatch, scaleFeat, scaleHannWin, scaleHog);
-        Mat scaleModelF_new, scaleAlphaF_new;
-        fft2(scaleFeat, scaleModelF_new);
-        train(scaleModelF_new, scaleGaussLabelF, scaleAlphaF_new, gaussCorrSigma, lambda);
-        accumulateWeighted(scaleModelF_new, scaleModelF, scaleLearnRate);
-        accumulateWeighted(scaleAlphaF_new, scaleAlphaF, scaleLearnRate);
+        CorrBranchBody body(this, &frameBuf, transDx, transDy, scale, scaleDx);
+        parallel_for_(Range(0, 2), body, 2);
+    }
+    else
+    {
+        updateTrans(frameBuf, transDx, transDy, scale);
+        if(useScale)
+            updateScale(frameBuf, scaleDx);
     }
     tgtRect.x = cvRound(tgtBox.x - tgtBox.width * 0.5);
     tgtRect.y = cvRound(tgtBox.y - tgtBox.height * 0.5);
     tgtRect.width = tgtBox.width;
     tgtRect.height = tgtBox.height;
     outRect = tgtRect;
+    if(allocCheck)
+        checkWorkspace(getAllocCount() - allocStart);
+    if(profiler.isEnabled())
+    {
+        profiler.add(STAGE_FRAME, getTickCount() - frameStart);
+        profiler.endFrame();
+    }
+}
 
+/**
+ * @brief 以YUV帧初始化目标, 直接读取亮度数据, 不拷贝也不做颜色转换
+ * @param yuv 帧数据首地址(NV12与I420为Y平面首地址)
+ * @param width 帧宽度(像素)
+ * @param height 帧高度(像素)
+ * @param stride 相邻两行首地址之间的字节数(NV12与I420为Y平面的行距)
+ * @param format YUV_NV12, YUV_I420或YUV_YUYV
+ * @param tgtRect 目标区域
+ */
+void CorrTrack::initTarget(const uchar *yuv, int width, int height, int stride, int format, Rect &tgtRect)
+{
+    Mat luma = wrapLuma(yuv, width, height, stride, format);
+    initTarget(luma, tgtRect);
+}
+
+/**
+ * @brief 以YUV帧跟踪目标, 参数同initTarget
+ */
+void CorrTrack::trackEachFrame(const uchar *yuv, int width, int height, int stride, int format, Rect &outRect)
+{
+    Mat luma = wrapLuma(yuv, width, height, stride, format);
+    trackEachFrame(luma, outRect);
+}
+
+/**
+ * @brief 平移分支的训练与模型更新, 目标区域须已更新为当前帧的结果
+ * @param frameBuf 当前帧
+ * @param transDx 训练窗口相对检测窗口的水平位移(特征单元)
+ * @param transDy 训练窗口相对检测窗口的垂直位移(特征单元)
+ * @param scale 检测得到的尺度变化
+ */
+void CorrTrack::updateTrans(Mat &frameBuf, float transDx, float transDy, float scale)
+{
+    //外观图像取自训练窗口, 图像块总是重新采样, 其代价远小于HOG与FFT
+    samplePatch(frameBuf, &winBox, transPatch);
+    //尺度几乎不变且位移较小时, 训练样本直接由检测样本的频谱平移得到
+    if(!(reuseFeatures && std::abs(scale - 1.0f) <= reuseScaleTol
+         && reuseSpectrum(transWs.featF, transWs.fft, transDx, transDy)))
+    {
+        getFeatures(transPatch, transFeat, transHannWin, transHog);
+        fft2(transFeat, transWs.featF, transWs.fft);
+    }
+    train(transWs.featF, transGaussLabelF, transWs.alphaF, gaussCorrSigma, lambda, &transWs);
+    STAGE_TIMER(&profiler, STAGE_UPDATE);
+    accumulateWeighted(transWs.featF, transModelF, transLearnRate);
+    accumulateWeighted(transWs.alphaF, transAlphaF, transLearnRate);
+    globalApp.convertTo(globalAppF, CV_32F);
+    accumulateWeighted(transPatch, globalAppF, transLearnRate);
+    globalAppF.convertTo(globalApp, CV_8U);
+    transPatch.copyTo(currentApp);
+    return;
+}
+
+/**
+ * @brief 尺度分支的训练与模型更新, 目标区域须已更新为当前帧的结果
+ * @param frameBuf 当前帧
+ * @param scaleDx 取整后的尺度变化对应的rho方向位移(特征单元)
+ */
+void CorrTrack::updateScale(Mat &frameBuf, float scaleDx)
+{
+    //对数极坐标下尺度变化即为沿rho方向(列)的平移
+    if(!(reuseFeatures && reuseSpectrum(scaleWs.featF, scaleWs.fft, scaleDx, 0)))
+    {
+        logPolarTransform(frameBuf, &tgtBox, scalePatch, scaleLpt);
+        getFeatures(scalePatch, scaleFeat, scaleHannWin, scaleHog);
+        fft2(scaleFeat, scaleWs.featF, scaleWs.fft);
+    }
+    train(scaleWs.featF, scaleGaussLabelF, scaleWs.alphaF, gaussCorrSigma, lambda, &scaleWs);
+    STAGE_TIMER(&profiler, STAGE_UPDATE);
+    accumulateWeighted(scaleWs.featF, scaleModelF, scaleLearnRate);
+    accumulateWeighted(scaleWs.alphaF, scaleAlphaF, scaleLearnRate);
+    return;
 }
 
 void CorrTrack::listPicFiles(const string picSeqPath)
 {
     string path = picSeqPath;
-    if(path[path.length()-1] != '\\')
-        path += '\\';
-    _chdir(path.c_str());
+    if(path[path.length()-1] != PATH_SEP)
+        path += PATH_SEP;
     picSeq.clear();
+#ifdef _WIN32
+    _chdir(path.c_str());
     char *filespec = "*.jpg";
     //首先查找dir中符合要求的文件
     long hFile;
@@ -397,20 +689,24 @@ void CorrTrack::listPicFiles(const string picSeqPath)
         } while (_findnext(hFile, &fileinfo) == 0);
         _findclose(hFile);
     }
+#else
+    vector<String> files;
+    glob(path + "*.jpg", files, false);
+    for(size_t i = 0; i < files.size(); i++)
+        picSeq.push_back(files[i]);
+#endif
     return;
 }
 
 void CorrTrack::readGroundTruth(const string datasetPath)
 {
     string path = datasetPath;
-    if(path[path.length()-1] != '\\')
-        path += '\\';
+    if(path[path.length()-1] != PATH_SEP)
+        path += PATH_SEP;
     path += "groundtruth_rect.txt";
-    char gt[_MAX_PATH];
-    strcpy(gt, path.c_str());
     FILE *fpgt;
     Rect tmp;
-    if((fpgt = fopen(gt, "r")) == NULL)
+    if((fpgt = fopen(path.c_str(), "r")) == NULL)
         perror("无法读取GroundTruth文件, 请确认是否存在!\n");
     bool commaGt = false;
     while(!feof(fpgt))
@@ -438,85 +734,20 @@ void CorrTrack::readGroundTruth(const string datasetPath)
 
 void CorrTrack::tracking()
 {
-    Mat I;
     double t, time = 0;
     double fps = 0;    
     while(1)
     {
-        cRectp rp = {0, 0, 0, 0};
         fillFrameBuf();
         if(frameBuf.empty())
             break;
-        if(sourceType == FROM_IMAGESEQUENCE && (frameNum >= groundTruth.size()-1 || frameNum >= picSeq.size()-1))
+        if(sourceType == FROM_IMAGESEQUENCE && (frameNum >= (int)groundTruth.size()-1 || frameNum >= (int)picSeq.size()-1))
             break;
-        if(frameBuf.channels() == 3)
-            cvtColor(frameBuf, I, CV_BGR2GRAY);
-        else
-            frameBuf.copyTo(I);
         t = (double)getTickCount();
-        getPatch(I, winPatch, &winBox);
-        resize(winPatch, transPatch, Size(transPatchNormSz, transPatchNormSz));
-        getFeatures(transPatch, transFeat, transHannWin, transHog);
-        Mat transXF, transResponse;
-        Point2f resPos;
-        fft2(transFeat, transXF);
-        detect(transXF, transModelF, transAlphaF, transResponse, resPos, gaussCorrSigma);
-
-        RectC2P(&winBox, &rp);
-        winBox.x = floor((resPos.x) * xZoom + rp.ltx);
-        winBox.y = floor((resPos.y) * yZoom + rp.lty);
-        tgtBox.x = winBox.x;
-        tgtBox.y = winBox.y;
-
-        if(useScale)
-        {
-            getPatch(I, tgtPatch, &tgtBox);
-            resize(tgtPatch, lptPatch, Size(scalePatchNormSz, scalePatchNormSz));
-            logPolarTransform(lptPatch, scalePatch, scaleLpt);
-            getFeatures(scalePatch, scaleFeat, scaleHannWin, scaleHog);
-            Mat scaleXF, scaleResponse;
-            float scale;
-            fft2(scaleFeat, scaleXF);
-            detect(scaleXF, scaleModelF, scaleAlphaF, scaleResponse, resPos, gaussCorrSigma);
-            scale = exp(-log(rhoMinRate) * (resPos.x - (scalePattSz - 1) * 0.5) / scalePattSz);
-            tgtBox.width = cvRound(1.0 * tgtBox.width * scale);
-            tgtBox.height = cvRound(1.0 * tgtBox.height * scale);
-            winBox.width = cvRound(1.0 * tgtBox.width * (padding + 1));
-            winBox.height = cvRound(1.0 * tgtBox.height * (padding + 1));
-            xZoom = 1.0 * (winBox.width - 1) / (transPattSz - 1);
-            yZoom = 1.0 * (winBox.height - 1) / (transPattSz - 1);
-        }
-
-        getPatch(I, winPatch, &winBox);
-        resize(winPatch, transPatch, Size(transPatchNormSz, transPatchNormSz));
-        getFeatures(transPatch, transFeat, transHannWin, transHog);
-        Mat transModelF_new, transAlphaF_new;
-        fft2(transFeat, transModelF_new);
-        train(transModelF_new, transGaussLabelF, transAlphaF_new, gaussCorrSigma, lambda);
-        accumulateWeighted(transModelF_new, transModelF, transLearnRate);
-        accumulateWeighted(transAlphaF_new, transAlphaF, transLearnRate);
-
-        if(useScale)
-        {
-            getPatch(I, tgtPatch, &tgtBox);
-            resize(tgtPatch, lptPatch, Size(scalePatchNormSz, scalePatchNormSz));
-            logPolarTransform(lptPatch, scalePatch, scaleLpt);
-            getFeatures(scalePatch, scaleFeat, scaleHannWin, scaleHog);
-            Mat scaleModelF_new, scaleAlphaF_new;
-            fft2(scaleFeat, scaleModelF_new);
-            train(scaleModelF_new, scaleGaussLabelF, scaleAlphaF_new, gaussCorrSigma, lambda);
-            accumulateWeighted(scaleModelF_new, scaleModelF, scaleLearnRate);
-            accumulateWeighted(scaleAlphaF_new, scaleAlphaF, scaleLearnRate);
-        }
-
-        tgtRect.x = cvRound(tgtBox.x - tgtBox.width * 0.5);
-        tgtRect.y = cvRound(tgtBox.y - tgtBox.height * 0.5);
-        tgtRect.width = tgtBox.width;
-        tgtRect.height = tgtBox.height;
-
+        trackEachFrame(frameBuf, tgtRect);
         t = (double)getTickCount() - t;
         time += t;
-        fps = frameNum / (time / getTickFrequency());
+        fps = (time > 0) ? frameNum / (time / getTickFrequency()) : 0;
 
         if(sourceType == FROM_IMAGESEQUENCE)
             rectangle(frameBuf, groundTruth[frameNum], Scalar(0,255,0), 2);
@@ -536,6 +767,7 @@ void CorrTrack::tracking()
         if(key == 13)
             break;        
     }
+    source.close();
     destroyAllWindows();
     return;
 }
@@ -637,6 +869,12 @@ void CorrTrack::getGaussLabelF(Mat &gaussLabelF, Size &patternSz, float sigma)
         }
     }
     dft(gaussLabel, gaussLabelF, DFT_COMPLEX_OUTPUT);
+    if(useHalfSpectrum)
+    {
+        //半频谱模式下只保留每行前width/2+1列
+        Mat half = gaussLabelF.colRange(0, patternSz.width / 2 + 1).clone();
+        gaussLabelF = half;
+    }
     return;
 }
 
@@ -658,31 +896,49 @@ void CorrTrack::getHannWindow(Mat &hannWindow, Size &patternSz)
     return;
 }
 
-void CorrTrack::logPolarTransform(Mat &src, Mat &dst, LPT_Grid *lpt)
+/**
+ * @brief 以rc为中心的目标区域的对数极坐标变换, 直接从整幅图像采样.
+ * 网格的源图像尺寸为归一化尺寸, 每次只把网格仿射映射到rc所在的位置与尺度,
+ * 相当于截取rc, 缩放到归一化尺寸再做变换, 但不生成中间图像
+ * @param inImg 输入图像, 灰度, YUYV或BGR
+ * @param rc 目标区域
+ * @param dst 输出的对数极坐标图像
+ * @param lpt LPT变换所需的插值网格结构
+ */
+void CorrTrack::logPolarTransform(Mat &inImg, cRectc *rc, Mat &dst, LPT_Grid *lpt)
 {
+    STAGE_TIMER(&profiler, STAGE_LPT);
     if(dst.data == NULL)
         dst.create(lpt->theta, lpt->rho, CV_8U);
     assert(lpt != NULL && dst.rows == lpt->theta && dst.cols == lpt->rho);
-    logPolar(src.data, dst.data, lpt);
+    assert(inImg.depth() == CV_8U && inImg.channels() <= 3 && dst.isContinuous());
+    cRectp rp = {0, 0, 0, 0};
+    RectC2P(rc, &rp);
+    rebaseLptGrid(lpt, rp.ltx + rc->width * 0.5f, rp.lty + rc->height * 0.5f, rc->width, rc->height);
+    logPolarFrame(inImg.data, inImg.cols, inImg.rows, (int)inImg.step[0], inImg.channels(), dst.data, lpt);
     return;
 }
 
-void CorrTrack::getPatch(Mat &inImg, Mat &outPatch, cRectc *rc)
+/**
+ * @brief 从图像中采样以rc为中心的区域并缩放到outPatch的尺寸, 超出图像的部分复制边界像素.
+ * 直接从整幅图像插值, 不生成中间的区域图像, 计算量只与outPatch的尺寸有关
+ * @param inImg 输入图像, 灰度, YUYV(2通道)或BGR, BGR图像只转换采样到的像素
+ * @param rc 采样区域
+ * @param outPatch 输出图像块, 须预先按归一化尺寸分配
+ */
+void CorrTrack::samplePatch(Mat &inImg, cRectc *rc, Mat &outPatch)
 {
+    STAGE_TIMER(&profiler, STAGE_PATCH);
     assert(rc->x >= 0 && rc->x < inImg.cols
            && rc->y >= 0 && rc->y < inImg.rows
            && rc->width >= 1 && rc->height >= 1);
+    assert(inImg.depth() == CV_8U && inImg.channels() <= 3 && outPatch.type() == CV_8U);
     cRectp rp = {0, 0, 0, 0};
     RectC2P(rc, &rp);
-    int lep = (rp.ltx > 0) ? 0 : abs(rp.ltx);
-    int tep = (rp.lty > 0) ? 0 : abs(rp.lty);
-    int rep = ((rp.rbx + 1 - inImg.cols) < 0) ? 0 : (rp.rbx + 1 - inImg.cols);
-    int bep = ((rp.rby + 1 - inImg.rows) < 0) ? 0 : (rp.rby + 1 - inImg.rows);
-    Rect roi(rp.ltx + lep, rp.lty + tep, rc->width - lep - rep, rc->height - tep - bep);
-    Mat tmp(inImg, roi);
-    if(outPatch.data == NULL)
-        outPatch.create(rc->height, rc->width, CV_8U);
-    copyMakeBorder(tmp, outPatch, tep, bep, lep, rep, BORDER_REPLICATE);
+    static const int FORMATS[4] = {RS_FORMAT_GRAY, RS_FORMAT_GRAY, RS_FORMAT_YUYV, RS_FORMAT_BGR};
+    RS_Image src = {inImg.data, inImg.cols, inImg.rows, (int)inImg.step[0], FORMATS[inImg.channels()]};
+    resamplePatch(&src, rp.ltx, rp.lty, rc->width, rc->height,
+                  outPatch.data, outPatch.cols, outPatch.rows, (int)outPatch.step[0], sampleMethod, &sampleScratch);
     return;
 }
 
@@ -730,16 +986,11 @@ void CorrTrack::getFeatures(Mat &img, Mat &feat, Mat &hannWin, FHOG *hog)
         feat.create(3, sz, CV_32F);
         assert(sz[1] == hannWin.rows && sz[2] == hannWin.cols);
     }
+    //余弦窗在HOG归一化输出时一并乘上, 不再单独遍历特征
+    assert(hannWin.type() == CV_32F && hannWin.isContinuous());
     float *featPtr = feat.ptr<float>(0, 0, 0);
-    calcHogFeature(hog, img.data, img.cols, img.rows, featPtr);
-    Mat tmp(hog->histHeight, hog->histWidth, CV_32F);
-    for(int i = 0; i < hog->dimension; i++)
-    {
-        featPtr = feat.ptr<float>(i, 0, 0);
-        Mat src(hog->histHeight, hog->histWidth, CV_32F, featPtr);
-        multiply(src, hannWin, tmp);
-        tmp.copyTo(src);
-    }
+    STAGE_TIMER(&profiler, STAGE_HOG);
+    calcHogFeatureWindowed(hog, img.data, img.cols, img.rows, hannWin.ptr<float>(0), featPtr);
     return;
 }
 
@@ -758,16 +1009,34 @@ bool CorrTrack::renderHOGFeatures(Mat &feat, Mat &renderImg, FHOG *hog)
     return true;
 }
 
-void CorrTrack::fft2(Mat &feat, Mat &featSpectrum)
+void CorrTrack::fft2(Mat &feat, Mat &featSpectrum, FFT_Plan *plan)
 {
+    STAGE_TIMER(&profiler, STAGE_FFT);
     if(feat.cols == -1 && feat.rows == -1)
     {
         //输入feature为HOG特征
         MatSize sz = feat.size; //尺寸从最高维(层, 第3维)到最低维(列, 第1维)依次排列
         assert(feat.dims == 3);
         assert(isPower2((unsigned int)sz[1]) && isPower2((unsigned int)sz[2]));
+        if(useHalfSpectrum)
+        {
+            //半频谱模式, 每个通道只保留width/2+1列
+            assert(plan && plan->height == sz[1] && plan->width == sz[2]);
+            int halfSz[3] = {sz[0], sz[1], getFftHalfWidth(plan)};
+            featSpectrum.create(3, halfSz, CV_32FC2);
+            assert(feat.isContinuous() && featSpectrum.isContinuous());
+            fft2dRealHalf(plan, feat.ptr<float>(0, 0, 0), featSpectrum.ptr<float>(0, 0, 0), sz[0]);
+            return;
+        }
         if(featSpectrum.data == NULL)
             featSpectrum.create(3, sz, CV_32FC2);
+        if(plan && plan->height == sz[1] && plan->width == sz[2])
+        {
+            //所有通道使用预先建立的FFT_Plan批量变换
+            assert(feat.isContinuous() && featSpectrum.isContinuous());
+            fft2dReal(plan, feat.ptr<float>(0, 0, 0), featSpectrum.ptr<float>(0, 0, 0), sz[0]);
+            return;
+        }
         for(int i = 0; i < sz[0]; i++)
         {
             float *psrc = feat.ptr<float>(i, 0, 0);
@@ -782,70 +1051,96 @@ void CorrTrack::fft2(Mat &feat, Mat &featSpectrum)
         //输入feature为RAW特征(灰度特征)
         assert(feat.dims == 2);
         assert(isPower2((unsigned int)feat.cols) && isPower2((unsigned int)feat.rows));
+        if(useHalfSpectrum)
+        {
+            assert(plan && plan->height == feat.rows && plan->width == feat.cols);
+            featSpectrum.create(feat.rows, getFftHalfWidth(plan), CV_32FC2);
+            assert(feat.isContinuous() && featSpectrum.isContinuous());
+            fft2dRealHalf(plan, feat.ptr<float>(0), featSpectrum.ptr<float>(0), 1);
+            return;
+        }
         if(featSpectrum.data == NULL)
             featSpectrum.create(feat.rows, feat.cols, CV_32FC2);
-        dft(feat, featSpectrum, DFT_COMPLEX_OUTPUT);
+        if(plan && plan->height == feat.rows && plan->width == feat.cols
+                && feat.isContinuous() && featSpectrum.isContinuous())
+            fft2dReal(plan, feat.ptr<float>(0), featSpectrum.ptr<float>(0), 1);
+        else
+            dft(feat, featSpectrum, DFT_COMPLEX_OUTPUT);
     }
     return;
 }
 
-void CorrTrack::ifft2(Mat &spectrum, Mat &response)
+void CorrTrack::ifft2(Mat &spectrum, Mat &response, FFT_Plan *plan)
 {
+    STAGE_TIMER(&profiler, STAGE_IFFT);
+    if(useHalfSpectrum)
+    {
+        //半频谱的列数为width/2+1, 输出尺寸由FFT_Plan决定
+        assert(plan && plan->height == spectrum.rows && getFftHalfWidth(plan) == spectrum.cols);
+        response.create(plan->height, plan->width, CV_32F);
+        assert(spectrum.isContinuous() && response.isContinuous());
+        ifft2dRealHalf(plan, spectrum.ptr<float>(0), response.ptr<float>(0));
+        return;
+    }
     if(response.data == NULL)
         response.create(spectrum.rows, spectrum.cols, CV_32F);
-    idft(spectrum, response, DFT_SCALE | DFT_REAL_OUTPUT);
+    if(plan && plan->height == spectrum.rows && plan->width == spectrum.cols
+            && spectrum.isContinuous() && response.isContinuous())
+        ifft2dReal(plan, spectrum.ptr<float>(0), response.ptr<float>(0));
+    else
+        idft(spectrum, response, DFT_SCALE | DFT_REAL_OUTPUT);
     return;
 }
 
-void CorrTrack::gaussCorrelationKernel(Mat &xF, Mat &yF, Mat &kernelF, float sigma, bool isTrain)
+/**
+ * @brief 计算高斯核相关, 中间结果与输出的核函数频谱(ws->kernelF)都保存在工作空间中
+ */
+void CorrTrack::gaussCorrelationKernel(Mat &xF, Mat &yF, float sigma, bool isTrain, CorrWorkspace *ws)
 {
-    double xNorm = getCplxNorm(xF);
-    double yNorm = isTrain ? xNorm : getCplxNorm(yF);
-    Mat xyf;
-    if(xF.rows == -1 && xF.cols == -1)
+    double xNorm, yNorm;
+    Mat &xyf = ws->xyf;
     {
-        assert(xF.dims == 3 && yF.dims == 3 && xF.channels() == 2 && xF.channels() == 2);
-        MatSize sz = xF.size;
-        Mat sum(sz[1], sz[2], CV_32FC2, Scalar::all(0));
-        for(int i = 0; i < sz[0]; i++)
+        STAGE_TIMER(&profiler, STAGE_KERNEL);
+        xNorm = getCplxNorm(xF);
+        yNorm = isTrain ? xNorm : getCplxNorm(yF);
+        assert(xF.isContinuous() && yF.isContinuous());
+        if(xF.rows == -1 && xF.cols == -1)
         {
-            float *pxf = xF.ptr<float>(i, 0, 0);
-            float *pyf = yF.ptr<float>(i, 0, 0);
-            Mat xtmp(sz[1], sz[2], CV_32FC2, pxf);
-            Mat ytmp(sz[1], sz[2], CV_32FC2, pyf);
-            Mat tmp(sz[1], sz[2], CV_32FC2);
-            mulSpectrums(xtmp, ytmp, tmp, DFT_ROWS, true);
-            accumulate(tmp, sum);
+            //各通道共轭相乘并求和, 一遍完成, 结果直接写入互相关频谱
+            assert(xF.dims == 3 && yF.dims == 3 && xF.channels() == 2 && xF.channels() == 2);
+            MatSize sz = xF.size;
+            xyf.create(sz[1], sz[2], CV_32FC2);
+            mulSpectrumsConjSum(xF.ptr<float>(0, 0, 0), yF.ptr<float>(0, 0, 0),
+                                xyf.ptr<float>(0), sz[1] * sz[2], sz[0]);
+        }
+        else
+        {
+            assert(xF.dims == 2 && yF.dims == 2 && xF.channels() == 2 && xF.channels() == 2);
+            xyf.create(xF.rows, xF.cols, CV_32FC2);
+            mulSpectrumsConjSum(xF.ptr<float>(0), yF.ptr<float>(0), xyf.ptr<float>(0), xF.rows * xF.cols, 1);
         }
-        sum.copyTo(xyf);
     }
-    else
+    Mat &xy = ws->xy;
+    ifft2(xyf, xy, ws->fft);
     {
-        assert(xF.dims == 2 && yF.dims == 2 && xF.channels() == 2 && xF.channels() == 2);
-        Mat sum(xF.rows, xF.cols, CV_32FC2, Scalar::all(0));
-        mulSpectrums(xF, yF, sum, DFT_ROWS, true);
-        sum.copyTo(xyf);
-    }
-    Mat xy(xyf.rows, xyf.cols, CV_32F);
-    idft(xyf, xy, DFT_SCALE | DFT_REAL_OUTPUT);
-    double scale = -1.0 / (sigma * sigma);
-    int n = xy.rows * xy.cols;
-    xNorm /= n;
-    yNorm /= n;
-    for(int i = 0; i < xy.rows; i++)
-    {
-        float *pxy = xy.ptr<float>(i, 0);
-        for(int j = 0; j < xy.cols; j++)
+        STAGE_TIMER(&profiler, STAGE_KERNEL);
+        double scale = -1.0 / (sigma * sigma);
+        int n = xy.rows * xy.cols;
+        xNorm /= n;
+        yNorm /= n;
+        for(int i = 0; i < xy.rows; i++)
         {
-            pxy[j] = MAX_VAL(0, xNorm + yNorm - 2 * pxy[j]);
-            pxy[j] *= scale;
-            pxy[j] /= n;
-            pxy[j] = exp(pxy[j]);
+            float *pxy = xy.ptr<float>(i, 0);
+            for(int j = 0; j < xy.cols; j++)
+            {
+                pxy[j] = MAX_VAL(0, xNorm + yNorm - 2 * pxy[j]);
+                pxy[j] *= scale;
+                pxy[j] /= n;
+                pxy[j] = exp(pxy[j]);
+            }
         }
     }
-    if(kernelF.data == NULL)
-        kernelF.create(xy.rows, xy.cols, CV_32FC2);
-    dft(xy, kernelF, DFT_COMPLEX_OUTPUT);
+    fft2(xy, ws->kernelF, ws->fft);
     return;
 }
 
@@ -853,69 +1148,118 @@ double CorrTrack::getCplxNorm(Mat &src)
 {
     assert(src.channels() == 2);
     double value = 0;
+    int nElem, nCols;
+    float *p;
     if(src.rows == -1 && src.cols == -1)
     {
         //多维复数矩阵
         assert(src.dims == 3);
         MatSize sz = src.size;
-        int nElem = sz[0] * sz[1] * sz[2];
-        float *p = src.ptr<float>(0, 0, 0);
-        for(int i = 0; i < nElem * 2; i++)
-            value += p[i] * p[i];
+        nElem = sz[0] * sz[1] * sz[2];
+        nCols = sz[2];
+        p = src.ptr<float>(0, 0, 0);
     }
     else
     {
         //普通的2维复数矩阵
         assert(src.dims == 2);
-        int nElem = src.cols * src.rows;
-        float *p = src.ptr<float>(0, 0);
+        nElem = src.cols * src.rows;
+        nCols = src.cols;
+        p = src.ptr<float>(0, 0);
+    }
+    if(!useHalfSpectrum)
+    {
         for(int i = 0; i < nElem * 2; i++)
             value += p[i] * p[i];
+        return value;
+    }
+    //半频谱中除第0列与第width/2列之外, 其余每列都对应完整频谱中的一对共轭列, 计为2倍
+    for(int i = 0; i < nElem; i += nCols)
+    {
+        double rowValue = 0;
+        float *pr = p + i * 2;
+        for(int j = 2; j < (nCols - 1) * 2; j++)
+            rowValue += pr[j] * pr[j];
+        value += 2 * rowValue;
+        value += pr[0] * pr[0] + pr[1] * pr[1];
+        value += pr[nCols * 2 - 2] * pr[nCols * 2 - 2] + pr[nCols * 2 - 1] * pr[nCols * 2 - 1];
     }
     return value;
 }
 
+/**
+ * @brief 由检测样本的频谱构造训练样本: 按训练窗口相对检测窗口的实际位移(含
+ * 小数部分)在频域中做循环平移, 位移为0时直接复用. 循环平移忽略了余弦窗与
+ * 边界处的差异, 因此只在位移不超过reuseMaxShift个特征单元时使用
+ * @param featSpectrum 检测样本的频谱, 成功时原地修改为训练样本的频谱
+ * @param plan 与频谱尺寸一致的FFT_Plan
+ * @param dx 水平位移(特征单元)
+ * @param dy 垂直位移(特征单元)
+ * @return 位移超出阈值时返回false, 频谱保持不变, 需重新提取特征
+ */
+bool CorrTrack::reuseSpectrum(Mat &featSpectrum, FFT_Plan *plan, float dx, float dy)
+{
+    if(std::abs(dx) > reuseMaxShift || std::abs(dy) > reuseMaxShift)
+        return false;
+    assert(featSpectrum.dims == 3 && featSpectrum.isContinuous());
+    MatSize sz = featSpectrum.size;
+    shiftSpectrum(plan, featSpectrum.ptr<float>(0, 0, 0), sz[2], sz[0], dx, dy);
+    return true;
+}
+
+/**
+ * @brief 以峰值点3x3邻域拟合二次曲面f = a*x^2 + b*x*y + c*y^2 + d*x + e*y + g,
+ * 以曲面极值点作为亚像素峰值位置.
+ * 坐标取相对峰值点的偏移, 设计矩阵为常量, 其伪逆即为PEAK_PINV中的系数, 拟合
+ * 只需一次9x5的乘加, 不必每次求解SVD. 响应图为循环相关的结果, 邻域越过边界时循环取值
+ * @param maxLoc 整像素峰值位置
+ * @param response 响应图
+ * @param subPixLoc 亚像素峰值位置
+ */
 void CorrTrack::getSubPixelPeak(Point &maxLoc, Mat &response, Point2f &subPixLoc)
 {
-    Point p1(maxLoc.x - 1, maxLoc.y - 1);
-    Point p2(maxLoc.x, maxLoc.y-1);
-    Point p3(maxLoc.x + 1, maxLoc.y - 1);
-    Point p4(maxLoc.x - 1, maxLoc.y);
-    Point p5(maxLoc.x + 1, maxLoc.y);
-    Point p6(maxLoc.x - 1, maxLoc.y + 1);
-    Point p7(maxLoc.x, maxLoc.y + 1);
-    Point p8(maxLoc.x + 1, maxLoc.y + 1);
-    Mat A = (Mat_<float>(9, 6) <<
-             p1.x * p1.x, p1.x * p1.y, p1.y * p1.y, p1.x, p1.y, 1.0f,
-             p2.x * p2.x, p2.x * p2.y, p2.y * p2.y, p2.x, p2.y, 1.0f,
-             p3.x * p3.x, p3.x * p3.y, p3.y * p3.y, p3.x, p3.y, 1.0f,
-             p4.x * p4.x, p4.x * p4.y, p4.y * p4.y, p4.x, p4.y, 1.0f,
-             p5.x * p5.x, p5.x * p5.y, p5.y * p5.y, p5.x, p5.y, 1.0f,
-             p6.x * p6.x, p6.x * p6.y, p6.y * p6.y, p6.x, p6.y, 1.0f,
-             p7.x * p7.x, p7.x * p7.y, p7.y * p7.y, p7.x, p7.y, 1.0f,
-             p8.x * p8.x, p8.x * p8.y, p8.y * p8.y, p8.x, p8.y, 1.0f,
-             maxLoc.x * maxLoc.x, maxLoc.x * maxLoc.y, maxLoc.y * maxLoc.y,
-             maxLoc.x, maxLoc.y, 1.0f);
-    Mat fval = (Mat_<float>(9, 1) <<
-                response.at<float>(p1), response.at<float>(p2), response.at<float>(p3), response.at<float>(p4),
-                response.at<float>(p5), response.at<float>(p6), response.at<float>(p7), response.at<float>(p8),
-                response.at<float>(maxLoc));
-    Mat x;
-    solve(A, fval, x, DECOMP_SVD);
-    float a = x.at<float>(0);
-    float b = x.at<float>(1);
-    float c = x.at<float>(2);
-    float d = x.at<float>(3);
-    float e = x.at<float>(4);
-    subPixLoc.y = (2.0f * a * e / b - d) / (b - (4 * a * c) / b);
-    subPixLoc.x = (-2.0f * c * subPixLoc.y - e) / b;
+    //邻域按行优先排列, 第k个点的偏移为(k % 3 - 1, k / 3 - 1)
+    static const float PEAK_PINV[5][9] = {
+        { 1.0f/6, -1.0f/3,  1.0f/6,  1.0f/6, -1.0f/3,  1.0f/6,  1.0f/6, -1.0f/3,  1.0f/6},  //a
+        { 0.25f,     0.0f, -0.25f,     0.0f,    0.0f,    0.0f, -0.25f,     0.0f,   0.25f},  //b
+        { 1.0f/6,  1.0f/6,  1.0f/6, -1.0f/3, -1.0f/3, -1.0f/3,  1.0f/6,  1.0f/6,  1.0f/6},  //c
+        {-1.0f/6,    0.0f,  1.0f/6, -1.0f/6,    0.0f,  1.0f/6, -1.0f/6,    0.0f,  1.0f/6},  //d
+        {-1.0f/6, -1.0f/6, -1.0f/6,    0.0f,    0.0f,    0.0f,  1.0f/6,  1.0f/6,  1.0f/6}   //e
+    };
+    float fval[9];
+    float coef[5] = {0, 0, 0, 0, 0};
+    for(int i = 0; i < 3; i++)
+    {
+        int y = (maxLoc.y + i - 1 + response.rows) % response.rows;
+        float *pr = response.ptr<float>(y);
+        for(int j = 0; j < 3; j++)
+            fval[i * 3 + j] = pr[(maxLoc.x + j - 1 + response.cols) % response.cols];
+    }
+    for(int k = 0; k < 5; k++)
+        for(int i = 0; i < 9; i++)
+            coef[k] += PEAK_PINV[k][i] * fval[i];
+    float a = coef[0];
+    float b = coef[1];
+    float c = coef[2];
+    float d = coef[3];
+    float e = coef[4];
+    //极值点满足2a*x + b*y = -d, b*x + 2c*y = -e
+    float det = 4 * a * c - b * b;
+    subPixLoc.x = maxLoc.x;
+    subPixLoc.y = maxLoc.y;
+    if(det != 0)
+    {
+        subPixLoc.x += (b * e - 2 * c * d) / det;
+        subPixLoc.y += (b * d - 2 * a * e) / det;
+    }
     return;
 }
 
-void CorrTrack::train(Mat &featSpectrum, Mat &gaussLabelF, Mat &alphaF, float sigma, float lambda)
+void CorrTrack::train(Mat &featSpectrum, Mat &gaussLabelF, Mat &alphaF, float sigma, float lambda, CorrWorkspace *ws)
 {
-    Mat kernelF;
-    gaussCorrelationKernel(featSpectrum, featSpectrum, kernelF, sigma, true);
+    Mat &kernelF = ws->kernelF;
+    gaussCorrelationKernel(featSpectrum, featSpectrum, sigma, true, ws);
+    STAGE_TIMER(&profiler, STAGE_UPDATE);
     if(alphaF.data == NULL)
         alphaF.create(gaussLabelF.rows, gaussLabelF.cols, CV_32FC2);
     for(int i = 0; i < gaussLabelF.rows; i++)
@@ -933,16 +1277,16 @@ void CorrTrack::train(Mat &featSpectrum, Mat &gaussLabelF, Mat &alphaF, float si
     return;
 }
 
-void CorrTrack::detect(Mat &featSpectrum, Mat &featModel, Mat &alphaF, Mat &response, Point2f &pos, float sigma)
+void CorrTrack::detect(Mat &featSpectrum, Mat &featModel, Mat &alphaF, Point2f &pos, float sigma, CorrWorkspace *ws)
 {
-    Mat kernelF;
-    gaussCorrelationKernel(featSpectrum, featModel, kernelF, sigma, false);
-    Mat tmp;
-    tmp.create(alphaF.rows, alphaF.cols, CV_32FC2);
-    mulSpectrums(alphaF, kernelF, tmp, DFT_ROWS, false);
-    if(response.data == NULL)
-        response.create(alphaF.rows, alphaF.cols, CV_32F);
-    ifft2(tmp, response);
+    Mat &response = ws->response;
+    gaussCorrelationKernel(featSpectrum, featModel, sigma, false, ws);
+    {
+        STAGE_TIMER(&profiler, STAGE_KERNEL);
+        mulSpectrums(alphaF, ws->kernelF, ws->responseF, DFT_ROWS, false);
+    }
+    ifft2(ws->responseF, response, ws->fft);
+    STAGE_TIMER(&profiler, STAGE_PEAK);
     Point maxLoc;
     int maxIdx[2];
     minMaxIdx(response, NULL, NULL, NULL, maxIdx);
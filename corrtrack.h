@@ -8,6 +8,10 @@
 
 #include "hog.h"
 #include "lpt.h"
+#include "fft.h"
+#include "resample.h"
+#include "stagetimer.h"
+#include "framesource.h"
 
 #ifdef MAX_VAL
 #undef MAX_VAL
@@ -18,6 +22,10 @@
 #define FROM_VIDEO          1
 #define FROM_IMAGESEQUENCE  2
 
+#define YUV_NV12            0   //Y平面后接交错的UV平面
+#define YUV_I420            1   //Y, U, V三个平面依次存放
+#define YUV_YUYV            2   //打包格式, 每2个像素存为Y0 U Y1 V
+
 typedef struct cRect
 {
     int x;      //Left-Top x
@@ -55,12 +63,40 @@ typedef struct TrackParam
     int scaleCellSz;
     int scaleGaussSigmaRate;
     double scaleLearnRate;
+    bool useHalfSpectrum;
+    bool reuseFeatures;
+    int sampleMethod;
+    bool parallelBranches;
+    bool parallelHog;
 } TrackParam;
 
+/*
+ * 平移与尺度两个分支各有一份CorrWorkspace, 保存该分支在检测与训练中
+ * 用到的全部中间结果. 所有矩阵在initTarget中按最终尺寸一次性分配,
+ * 之后每一帧只在其中读写, 跟踪过程中不再申请堆内存.
+ */
+typedef struct CorrWorkspace
+{
+    FFT_Plan *fft;          //该分支的FFT_Plan
+    cv::Mat featF;          //当前帧特征频谱
+    cv::Mat xyf;            //互相关频谱
+    cv::Mat xy;             //互相关(空域)
+    cv::Mat kernelF;        //核函数频谱
+    cv::Mat responseF;      //检测响应频谱
+    cv::Mat response;       //检测响应
+    cv::Mat alphaF;         //当前帧训练得到的系数频谱
+} CorrWorkspace;
+
+#define CORR_SNAPSHOT_MAX 40
+
 class CorrTrack
 {
 public:
     bool useScale;    
+    bool useHalfSpectrum;
+    bool reuseFeatures;
+    bool parallelBranches;
+    bool parallelHog;
     int sourceType;
     int frameNum;
     cv::Mat frameBuf;
@@ -85,6 +121,9 @@ private:
     float rhoMinRate;
     float rhoMax;
     float rhoMin;
+    int reuseMaxShift;
+    float reuseScaleTol;
+    int sampleMethod;
 
     cv::Rect tgtRect;
     cRectc tgtBox;
@@ -93,15 +132,16 @@ private:
     float yZoom;
     int startN;
 
-    cv::Mat tgtPatch;
-    cv::Mat winPatch;
-    cv::Mat lptPatch;
+    cv::Mat globalAppF;
     cv::Mat transPatch;
     cv::Mat scalePatch;
 
     FHOG *transHog;
     FHOG *scaleHog;
     LPT_Grid *scaleLpt;
+    RS_Scratch sampleScratch;   //区域插值采样的列坐标与权重, 在initTarget中按帧宽分配
+    CorrWorkspace transWs;
+    CorrWorkspace scaleWs;
 
     cv::Mat transGaussLabelF;
     cv::Mat transHannWin;
@@ -116,7 +156,14 @@ private:
 
     std::vector<std::string> picSeq;
     std::vector<cv::Rect> groundTruth;
-    cv::VideoCapture video;
+    FrameSource source;
+
+    StageProfiler profiler;
+    bool dumpProfile;
+
+    bool allocCheck;
+    int snapshotCount;
+    const uchar *snapshot[CORR_SNAPSHOT_MAX];
 
     std::string windowName;
 
@@ -135,6 +182,11 @@ public:
     virtual void initParam(TrackParam *param);
     virtual void initTarget(cv::Mat &frameBuf, cv::Rect &tgtRect);
     virtual void trackEachFrame(cv::Mat &frameBuf, cv::Rect &outRect);
+    virtual void initTarget(const uchar *yuv, int width, int height, int stride, int format, cv::Rect &tgtRect);
+    virtual void trackEachFrame(const uchar *yuv, int width, int height, int stride, int format, cv::Rect &outRect);
+    virtual void setAllocCheck(bool enable);
+    virtual void setProfiling(bool enable, bool dumpAtExit = false);
+    virtual const StageProfiler& getProfiler() const;
 private:
     virtual void listPicFiles(const std::string picSeqPath);
     virtual void readGroundTruth(const std::string datasetPath);
@@ -143,23 +195,32 @@ private:
     virtual void fillFrameBuf();
     virtual void initFristFrame();
     virtual void tracking();
-private:
+    virtual void releaseDescriptors();
+    virtual int getWorkspaceData(const uchar **data);
+    virtual void checkWorkspace(int allocs);
+
+    friend class CorrBranchBody;
+protected:
+    virtual void initWorkspace(CorrWorkspace *ws, int pattSz, int channels);
+    virtual void updateTrans(cv::Mat &frameBuf, float transDx, float transDy, float scale);
+    virtual void updateScale(cv::Mat &frameBuf, float scaleDx);
     virtual void mouseSelect(const char *window, cv::Mat &src, cv::Rect &roi);
     virtual void getGaussLabelF(cv::Mat &gaussLabelF, cv::Size &patternSz, float sigma);
     virtual void getHannWindow(cv::Mat &hannWindow, cv::Size &patternSz);
-    virtual void logPolarTransform(cv::Mat &src, cv::Mat &dst, LPT_Grid *lpt);
-    virtual void getPatch(cv::Mat &inImg, cv::Mat &outPatch, cRectc *rc);
+    virtual void logPolarTransform(cv::Mat &inImg, cRectc *rc, cv::Mat &dst, LPT_Grid *lpt);
+    virtual void samplePatch(cv::Mat &inImg, cRectc *rc, cv::Mat &outPatch);
     virtual void getFeatures(cv::Mat &img, cv::Mat &feat, cv::Mat &hannWin);
     virtual void getFeatures(cv::Mat &img, cv::Mat &feat, FHOG *hog);
     virtual void getFeatures(cv::Mat &img, cv::Mat &feat, cv::Mat &hannWin, FHOG *hog);
     virtual bool renderHOGFeatures(cv::Mat &feat, cv::Mat &renderImg, FHOG *hog);
-    virtual void fft2(cv::Mat &feat, cv::Mat &featSpectrum);
-    virtual void ifft2(cv::Mat &spectrum, cv::Mat &response);
-    virtual void gaussCorrelationKernel(cv::Mat &xF, cv::Mat &yF, cv::Mat &kernelF, float sigma, bool isTrain);
+    virtual void fft2(cv::Mat &feat, cv::Mat &featSpectrum, FFT_Plan *plan);
+    virtual void ifft2(cv::Mat &spectrum, cv::Mat &response, FFT_Plan *plan);
+    virtual void gaussCorrelationKernel(cv::Mat &xF, cv::Mat &yF, float sigma, bool isTrain, CorrWorkspace *ws);
     virtual double getCplxNorm(cv::Mat &src);
+    virtual bool reuseSpectrum(cv::Mat &featSpectrum, FFT_Plan *plan, float dx, float dy);
     virtual void getSubPixelPeak(cv::Point &maxLoc, cv::Mat &response, cv::Point2f &subPixLoc);
-    virtual void train(cv::Mat &featSpectrum, cv::Mat &gaussLabelF, cv::Mat &alphaF, float sigma, float lambda);
-    virtual void detect(cv::Mat &featSpectrum, cv::Mat &featModel, cv::Mat &alphaF, cv::Mat &response, cv::Point2f &pos, float sigma);
+    virtual void train(cv::Mat &featSpectrum, cv::Mat &gaussLabelF, cv::Mat &alphaF, float sigma, float lambda, CorrWorkspace *ws);
+    virtual void detect(cv::Mat &featSpectrum, cv::Mat &featModel, cv::Mat &alphaF, cv::Point2f &pos, float sigma, CorrWorkspace *ws);
 };
 
 inline int isEven(int x)
@@ -215,5 +276,6 @@ inline void Rect2C(cv::Rect &r, cRectc *rc)
     rc->height = r.height;
 }
 
+void cvHogParallelFor(void *pool, int count, HogTask task, void *arg);
 
 #endif // CORRTRACK_H
@@ -0,0 +1,538 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "fft.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define FFT_USE_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define FFT_USE_SSE2
+#endif
+
+/* 共轭相乘求和时每次处理的复数个数, 该块内的累加结果始终驻留在L1缓存中 */
+#define FFT_SUM_BLOCK 256
+#define MIN_BLOCK(x, y) (((x) < (y)) ? (x) : (y))
+
+static int *newBitReverseTable(int n);
+static float *newTwiddleTable(int n);
+static void fftCore(float *data, int n, int stride, int count, const int *rev, const float *tw, int inverse);
+static void getTwiddle(const float *tw, int n, int m, float *re, float *im);
+
+
+/**
+ * @brief 新建FFT_Plan结构
+ * @param width 变换宽度(列数), 须为2的整数次幂且不小于2
+ * @param height 变换高度(行数), 须为2的整数次幂且不小于2
+ * @return FFT_Plan结构
+ * 同一尺寸的所有变换共用一个FFT_Plan, 位反转表与旋转因子只在此处计算一次.
+ * 由于FFT_Plan内含逆变换的工作缓存, 同一个FFT_Plan不可被多个线程同时使用.
+ */
+FFT_Plan *newFftPlan(int width, int height)
+{
+    FFT_Plan *plan;
+    assert(width >= 2 && height >= 2);
+    assert((width & (width - 1)) == 0 && (height & (height - 1)) == 0);
+    plan = (FFT_Plan*)malloc(sizeof(FFT_Plan));
+    assert(plan != NULL);
+    plan->width = width;
+    plan->height = height;
+    plan->colRev = newBitReverseTable(width);
+    plan->rowRev = newBitReverseTable(height);
+    plan->colTwiddle = newTwiddleTable(width);
+    plan->rowTwiddle = newTwiddleTable(height);
+    plan->buf = (float*)malloc(sizeof(float) * width * (height + 1) * 2);
+    assert(plan->buf != NULL);
+    return plan;
+}
+
+/**
+ * @brief 释放FFT_Plan结构
+ * @param plan
+ */
+void freeFftPlan(FFT_Plan *plan)
+{
+    if(!plan)
+        return;
+    free(plan->colRev);
+    free(plan->rowRev);
+    free(plan->colTwiddle);
+    free(plan->rowTwiddle);
+    free(plan->buf);
+    free(plan);
+    return;
+}
+
+/**
+ * @brief 多通道实数矩阵的批量二维FFT
+ * @param plan 与输入尺寸一致的FFT_Plan
+ * @param src 实数输入, channels个height*width的矩阵连续存放
+ * @param dst 复数输出, channels个height*width的复数矩阵连续存放(实部虚部交错)
+ * @param channels 通道数
+ * 输出为完整频谱, 与cv::dft(src, dst, DFT_COMPLEX_OUTPUT)的结果一致.
+ * 相邻两行实数数据合并为一个复数序列做行变换, 再利用共轭对称性拆分:
+ * 设z = a + i*b, 则A[k] = (Z[k] + conj(Z[N-k])) / 2, B[k] = (Z[k] - conj(Z[N-k])) / 2i
+ */
+void fft2dReal(FFT_Plan *plan, const float *src, float *dst, int channels)
+{
+    int c, r, x, k;
+    int w = plan->width;
+    int h = plan->height;
+    assert(src != NULL && dst != NULL && channels >= 1);
+    for(c = 0; c < channels; c++)
+    {
+        const float *ps = src + c * w * h;
+        float *pd = dst + c * w * h * 2;
+        for(r = 0; r < h; r += 2)
+        {
+            const float *sa = ps + r * w;
+            const float *sb = sa + w;
+            float *za = pd + r * w * 2;
+            float *zb = za + w * 2;
+            /* 两行实数合并成一行复数 */
+            for(x = 0; x < w; x++)
+            {
+                za[2*x] = sa[x];
+                za[2*x+1] = sb[x];
+            }
+            fftCore(za, w, 1, 1, plan->colRev, plan->colTwiddle, 0);
+            /* 拆分出两行各自的频谱, k与N-k成对处理, 以便原地完成 */
+            for(k = 0; k <= (w >> 1); k++)
+            {
+                int m = (w - k) & (w - 1);
+                float zkr = za[2*k], zki = za[2*k+1];
+                float zmr = za[2*m], zmi = za[2*m+1];
+                float ar = 0.5f * (zkr + zmr);
+                float ai = 0.5f * (zki - zmi);
+                float br = 0.5f * (zki + zmi);
+                float bi = 0.5f * (zmr - zkr);
+                za[2*k] = ar;
+                za[2*k+1] = ai;
+                za[2*m] = ar;
+                za[2*m+1] = -ai;
+                zb[2*k] = br;
+                zb[2*k+1] = bi;
+                zb[2*m] = br;
+                zb[2*m+1] = -bi;
+            }
+        }
+        /* 列变换: 每一行作为一个向量参与蝶形运算 */
+        fftCore(pd, h, w, w, plan->rowRev, plan->rowTwiddle, 0);
+    }
+    return;
+}
+
+/**
+ * @brief 共轭对称频谱的二维逆FFT, 输出实数矩阵
+ * @param plan 与输入尺寸一致的FFT_Plan
+ * @param src 复数输入(完整频谱, 须满足共轭对称)
+ * @param dst 实数输出
+ * 结果已除以width*height, 与cv::idft(src, dst, DFT_SCALE | DFT_REAL_OUTPUT)的结果一致.
+ * 列逆变换后, 相邻两行频谱A, B合并为Z = A + i*B做一次行逆变换, 其实部与虚部即为两行实数结果.
+ */
+void ifft2dReal(FFT_Plan *plan, const float *src, float *dst)
+{
+    int r, x;
+    int w = plan->width;
+    int h = plan->height;
+    float scale = 1.0f / (w * h);
+    float *buf = plan->buf;
+    assert(src != NULL && dst != NULL);
+    memcpy(buf, src, sizeof(float) * w * h * 2);
+    fftCore(buf, h, w, w, plan->rowRev, plan->rowTwiddle, 1);
+    for(r = 0; r < h; r += 2)
+    {
+        float *za = buf + r * w * 2;
+        const float *zb = za + w * 2;
+        float *da = dst + r * w;
+        float *db = da + w;
+        for(x = 0; x < w; x++)
+        {
+            float ar = za[2*x], ai = za[2*x+1];
+            za[2*x] = ar - zb[2*x+1];
+            za[2*x+1] = ai + zb[2*x];
+        }
+        fftCore(za, w, 1, 1, plan->colRev, plan->colTwiddle, 1);
+        for(x = 0; x < w; x++)
+        {
+            da[x] = za[2*x] * scale;
+            db[x] = za[2*x+1] * scale;
+        }
+    }
+    return;
+}
+
+/**
+ * @brief 多通道实数矩阵的批量二维FFT, 只输出半频谱
+ * @param plan 与输入尺寸一致的FFT_Plan
+ * @param src 实数输入, channels个height*width的矩阵连续存放
+ * @param dst 复数输出, channels个height*(width/2+1)的复数矩阵连续存放
+ * @param channels 通道数
+ * 输出即为完整频谱中每行的前width/2+1列, 其余列满足F(u, v) = conj(F(-u, -v)).
+ */
+void fft2dRealHalf(FFT_Plan *plan, const float *src, float *dst, int channels)
+{
+    int c, r, x, k;
+    int w = plan->width;
+    int h = plan->height;
+    int hw = (w >> 1) + 1;
+    float *z = plan->buf;
+    assert(src != NULL && dst != NULL && channels >= 1);
+    for(c = 0; c < channels; c++)
+    {
+        const float *ps = src + c * w * h;
+        float *pd = dst + c * hw * h * 2;
+        for(r = 0; r < h; r += 2)
+        {
+            const float *sa = ps + r * w;
+            const float *sb = sa + w;
+            float *da = pd + r * hw * 2;
+            float *db = da + hw * 2;
+            for(x = 0; x < w; x++)
+            {
+                z[2*x] = sa[x];
+                z[2*x+1] = sb[x];
+            }
+            fftCore(z, w, 1, 1, plan->colRev, plan->colTwiddle, 0);
+            for(k = 0; k < hw; k++)
+            {
+                int m = (w - k) & (w - 1);
+                da[2*k] = 0.5f * (z[2*k] + z[2*m]);
+                da[2*k+1] = 0.5f * (z[2*k+1] - z[2*m+1]);
+                db[2*k] = 0.5f * (z[2*k+1] + z[2*m+1]);
+                db[2*k+1] = 0.5f * (z[2*m] - z[2*k]);
+            }
+        }
+        fftCore(pd, h, hw, hw, plan->rowRev, plan->rowTwiddle, 0);
+    }
+    return;
+}
+
+/**
+ * @brief 半频谱的二维逆FFT, 输出实数矩阵
+ * @param plan 与输出尺寸一致的FFT_Plan
+ * @param src 复数输入, height*(width/2+1)的半频谱
+ * @param dst 实数输出, height*width
+ * 结果已除以width*height. 列逆变换后, 每行缺失的后半部分由共轭对称性补全,
+ * 再按ifft2dReal()中的方法两行合一做行逆变换.
+ */
+void ifft2dRealHalf(FFT_Plan *plan, const float *src, float *dst)
+{
+    int r, k;
+    int w = plan->width;
+    int h = plan->height;
+    int hw = (w >> 1) + 1;
+    float scale = 1.0f / (w * h);
+    float *buf = plan->buf;
+    float *z = plan->buf + hw * h * 2;
+    assert(src != NULL && dst != NULL);
+    memcpy(buf, src, sizeof(float) * hw * h * 2);
+    fftCore(buf, h, hw, hw, plan->rowRev, plan->rowTwiddle, 1);
+    for(r = 0; r < h; r += 2)
+    {
+        const float *za = buf + r * hw * 2;
+        const float *zb = za + hw * 2;
+        float *da = dst + r * w;
+        float *db = da + w;
+        /* Z = A + i*B, 后半部分A[k] = conj(A[w-k]), B[k] = conj(B[w-k]) */
+        for(k = 0; k < hw; k++)
+        {
+            z[2*k] = za[2*k] - zb[2*k+1];
+            z[2*k+1] = za[2*k+1] + zb[2*k];
+        }
+        for(k = hw; k < w; k++)
+        {
+            int m = w - k;
+            z[2*k] = za[2*m] + zb[2*m+1];
+            z[2*k+1] = zb[2*m] - za[2*m+1];
+        }
+        fftCore(z, w, 1, 1, plan->colRev, plan->colTwiddle, 1);
+        for(k = 0; k < w; k++)
+        {
+            da[k] = z[2*k] * scale;
+            db[k] = z[2*k+1] * scale;
+        }
+    }
+    return;
+}
+
+/**
+ * @brief 获取半频谱每行的复数个数
+ * @param plan
+ * @return width/2+1
+ */
+int getFftHalfWidth(const FFT_Plan *plan)
+{
+    return (plan->width >> 1) + 1;
+}
+
+/**
+ * @brief 多通道频谱共轭相乘并求和: dst[i] = sum_c(a_c[i] * conj(b_c[i]))
+ * @param a 第一组频谱, channels个频谱连续存放, 每个频谱n个复数
+ * @param b 第二组频谱, 存放方式同a
+ * @param dst 输出频谱, n个复数
+ * @param n 每个通道的复数个数
+ * @param channels 通道数
+ * 与逐通道mulSpectrums(..., conjB = true)再accumulate相比, 每个输入只读一遍,
+ * 且不产生中间结果. 数据按FFT_SUM_BLOCK分块, 块内沿通道连续累加, 累加结果
+ * 直接写在dst中并始终留在L1缓存里.
+ * 复数乘法(ar + i*ai) * (br - i*bi) = (ar*br + ai*bi) + i*(ai*br - ar*bi)
+ */
+void mulSpectrumsConjSum(const float *a, const float *b, float *dst, int n, int channels)
+{
+    int start, c, i;
+    assert(a != NULL && b != NULL && dst != NULL && channels >= 1);
+    for(start = 0; start < n; start += FFT_SUM_BLOCK)
+    {
+        int len = MIN_BLOCK(n - start, FFT_SUM_BLOCK);
+        float *pd = dst + start * 2;
+        memset(pd, 0, sizeof(float) * len * 2);
+        for(c = 0; c < channels; c++)
+        {
+            const float *pa = a + ((size_t)c * n + start) * 2;
+            const float *pb = b + ((size_t)c * n + start) * 2;
+            i = 0;
+#if defined(FFT_USE_AVX2)
+            for(; i + 4 <= len; i += 4)
+            {
+                __m256 va = _mm256_loadu_ps(pa + i * 2);
+                __m256 vb = _mm256_loadu_ps(pb + i * 2);
+                __m256 bre = _mm256_moveldup_ps(vb); /* br br */
+                __m256 bim = _mm256_movehdup_ps(vb); /* bi bi */
+                __m256 aswap = _mm256_permute_ps(va, 0xB1); /* ai ar */
+                /* (ar*br, ai*br) + (ai*bi, -ar*bi) */
+                __m256 t = _mm256_xor_ps(_mm256_mul_ps(aswap, bim),
+                                         _mm256_set_ps(-0.0f, 0.0f, -0.0f, 0.0f, -0.0f, 0.0f, -0.0f, 0.0f));
+                __m256 prod = _mm256_add_ps(_mm256_mul_ps(va, bre), t);
+                _mm256_storeu_ps(pd + i * 2, _mm256_add_ps(_mm256_loadu_ps(pd + i * 2), prod));
+            }
+#elif defined(FFT_USE_SSE2)
+            for(; i + 2 <= len; i += 2)
+            {
+                __m128 va = _mm_loadu_ps(pa + i * 2);
+                __m128 vb = _mm_loadu_ps(pb + i * 2);
+                __m128 bre = _mm_shuffle_ps(vb, vb, _MM_SHUFFLE(2, 2, 0, 0));
+                __m128 bim = _mm_shuffle_ps(vb, vb, _MM_SHUFFLE(3, 3, 1, 1));
+                __m128 aswap = _mm_shuffle_ps(va, va, _MM_SHUFFLE(2, 3, 0, 1));
+                /* (ar*br, ai*br) + (ai*bi, -ar*bi) */
+                __m128 t = _mm_xor_ps(_mm_mul_ps(aswap, bim), _mm_set_ps(-0.0f, 0.0f, -0.0f, 0.0f));
+                __m128 prod = _mm_add_ps(_mm_mul_ps(va, bre), t);
+                _mm_storeu_ps(pd + i * 2, _mm_add_ps(_mm_loadu_ps(pd + i * 2), prod));
+            }
+#endif
+            for(; i < len; i++)
+            {
+                float ar = pa[2*i], ai = pa[2*i+1];
+                float br = pb[2*i], bi = pb[2*i+1];
+                pd[2*i] += ar * br + ai * bi;
+                pd[2*i+1] += ai * br - ar * bi;
+            }
+        }
+    }
+    return;
+}
+
+/**
+ * @brief 频域循环平移: 使频谱对应的空域信号循环平移为new(y, x) = old(y + dy, x + dx)
+ * @param plan 与频谱尺寸一致的FFT_Plan
+ * @param spec 复数频谱, channels个height*cols的频谱连续存放, 原地修改
+ * @param cols 每行的复数个数, 完整频谱为width, 半频谱为width/2+1
+ * @param channels 通道数
+ * @param dx 水平平移量(列), 可为小数
+ * @param dy 垂直平移量(行), 可为小数
+ * 由平移定理, F'(v, u) = F(v, u) * exp(2*pi*i*(u*dx/width + v*dy/height)),
+ * 对整数平移量而言相位因子恰为旋转因子表中的元素, 无需计算三角函数.
+ * 小数平移量按有符号频率(-n/2, n/2]计算相位, 使空域结果保持为实数, Nyquist
+ * 频率只取相位因子的实部; 每行与每列的相位因子各算一次, 存放在plan的工作缓存中.
+ */
+void shiftSpectrum(const FFT_Plan *plan, float *spec, int cols, int channels, float dx, float dy)
+{
+    int c, v, u;
+    int w = plan->width;
+    int h = plan->height;
+    int idx = (int)dx;
+    int idy = (int)dy;
+    float *colPhase = plan->buf;
+    float *rowPhase = plan->buf + cols * 2;
+    assert(spec != NULL && channels >= 1);
+    assert(cols == w || cols == (w >> 1) + 1);
+    if(dx == 0 && dy == 0)
+        return;
+    if(idx == dx && idy == dy)
+    {
+        for(u = 0; u < cols; u++)
+            getTwiddle(plan->colTwiddle, w, (-u * idx) & (w - 1), &colPhase[2*u], &colPhase[2*u+1]);
+        /* exp(2*pi*i*v*dy/h) = exp(-2*pi*i*(-v*dy)/h) */
+        for(v = 0; v < h; v++)
+            getTwiddle(plan->rowTwiddle, h, (-v * idy) & (h - 1), &rowPhase[2*v], &rowPhase[2*v+1]);
+    }
+    else
+    {
+        for(u = 0; u < cols; u++)
+        {
+            double a = 2 * FFT_PI * (u <= w / 2 ? u : u - w) * dx / w;
+            colPhase[2*u] = (float)cos(a);
+            colPhase[2*u+1] = (u == w / 2) ? 0.f : (float)sin(a);
+        }
+        for(v = 0; v < h; v++)
+        {
+            double a = 2 * FFT_PI * (v <= h / 2 ? v : v - h) * dy / h;
+            rowPhase[2*v] = (float)cos(a);
+            rowPhase[2*v+1] = (v == h / 2) ? 0.f : (float)sin(a);
+        }
+    }
+    for(c = 0; c < channels; c++)
+    {
+        float *pc = spec + (size_t)c * h * cols * 2;
+        for(v = 0; v < h; v++)
+        {
+            float rr = rowPhase[2*v], ri = rowPhase[2*v+1];
+            float *p = pc + v * cols * 2;
+            for(u = 0; u < cols; u++)
+            {
+                float cr = colPhase[2*u], ci = colPhase[2*u+1];
+                float pr, pi, fr, fi;
+                pr = rr * cr - ri * ci;
+                pi = rr * ci + ri * cr;
+                fr = p[2*u];
+                fi = p[2*u+1];
+                p[2*u] = fr * pr - fi * pi;
+                p[2*u+1] = fr * pi + fi * pr;
+            }
+        }
+    }
+    return;
+}
+
+/**
+ * @brief 从只保存前n/2项的旋转因子表中取出exp(-2*pi*i*m/n), 0 <= m < n
+ * 后一半由exp(-2*pi*i*(m+n/2)/n) = -exp(-2*pi*i*m/n)得到
+ */
+static void getTwiddle(const float *tw, int n, int m, float *re, float *im)
+{
+    int half = n >> 1;
+    if(m < half)
+    {
+        *re = tw[2*m];
+        *im = tw[2*m+1];
+    }
+    else
+    {
+        *re = -tw[2*(m-half)];
+        *im = -tw[2*(m-half)+1];
+    }
+}
+
+/**
+ * @brief 生成长度为n的位反转表
+ * @param n 变换长度
+ * @return
+ */
+static int *newBitReverseTable(int n)
+{
+    int i, bits = 0;
+    int *rev = (int*)malloc(sizeof(int) * n);
+    assert(rev != NULL);
+    while((1 << bits) < n)
+        bits++;
+    for(i = 0; i < n; i++)
+    {
+        int j, v = 0;
+        for(j = 0; j < bits; j++)
+            v |= ((i >> j) & 1) << (bits - 1 - j);
+        rev[i] = v;
+    }
+    return rev;
+}
+
+/**
+ * @brief 生成长度为n的正变换旋转因子表, 共n/2个复数exp(-2*pi*i*k/n)
+ * @param n 变换长度
+ * @return
+ */
+static float *newTwiddleTable(int n)
+{
+    int k;
+    float *tw = (float*)malloc(sizeof(float) * n);
+    assert(tw != NULL);
+    for(k = 0; k < (n >> 1); k++)
+    {
+        tw[2*k] = (float)cos(2 * FFT_PI * k / n);
+        tw[2*k+1] = (float)-sin(2 * FFT_PI * k / n);
+    }
+    return tw;
+}
+
+/**
+ * @brief 基2时域抽取FFT核心, 原地计算
+ * @param data 数据首地址
+ * @param n 变换长度(点数)
+ * @param stride 相邻两点间隔的复数个数
+ * @param count 每一点包含的连续复数个数, 所有复数同时参与同一组蝶形运算
+ * @param rev 位反转表
+ * @param tw 旋转因子表
+ * @param inverse 是否为逆变换(不做归一化)
+ * 行变换时stride = 1, count = 1; 列变换时stride = count = 矩阵宽度,
+ * 此时一个"点"即为一整行, 最内层循环沿行连续访存.
+ */
+static void fftCore(float *data, int n, int stride, int count, const int *rev, const float *tw, int inverse)
+{
+    int i, j, k, len;
+    int vec = count * 2;
+    /* 位反转重排 */
+    for(i = 0; i < n; i++)
+    {
+        j = rev[i];
+        if(i < j)
+        {
+            float *a = data + 2 * i * stride;
+            float *b = data + 2 * j * stride;
+            for(k = 0; k < vec; k++)
+            {
+                float t = a[k];
+                a[k] = b[k];
+                b[k] = t;
+            }
+        }
+    }
+    /* 第1级蝶形, 旋转因子恒为1 */
+    for(i = 0; i < n; i += 2)
+    {
+        float *a = data + 2 * i * stride;
+        float *b = a + 2 * stride;
+        for(k = 0; k < vec; k++)
+        {
+            float t = b[k];
+            b[k] = a[k] - t;
+            a[k] += t;
+        }
+    }
+    /* 其余各级蝶形 */
+    for(len = 4; len <= n; len <<= 1)
+    {
+        int half = len >> 1;
+        int twStep = n / len;
+        for(i = 0; i < n; i += len)
+        {
+            for(j = 0; j < half; j++)
+            {
+                float wr = tw[2 * j * twStep];
+                float wi = inverse ? -tw[2 * j * twStep + 1] : tw[2 * j * twStep + 1];
+                float *a = data + 2 * (i + j) * stride;
+                float *b = data + 2 * (i + j + half) * stride;
+                for(k = 0; k < vec; k += 2)
+                {
+                    float tr = b[k] * wr - b[k+1] * wi;
+                    float ti = b[k] * wi + b[k+1] * wr;
+                    b[k] = a[k] - tr;
+                    b[k+1] = a[k+1] - ti;
+                    a[k] += tr;
+                    a[k+1] += ti;
+                }
+            }
+        }
+    }
+    return;
+}
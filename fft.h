@@ -0,0 +1,65 @@
+/*
+ * fft.h与fft.c实现了面向相关滤波跟踪的批量二维快速傅里叶变换.
+ * 跟踪过程中, 同一个跟踪器每一帧都要对尺寸固定(如32x32, 64x64)的多
+ * 通道HOG特征做二维FFT, 因此将基2蝶形运算所需的位反转表与旋转因子
+ * 预先计算并保存在FFT_Plan结构中, 之后所有的变换都复用同一个FFT_Plan,
+ * 不再有任何初始化开销与内存分配.
+ * 实数输入的变换采用"两行合一"的技巧: 将相邻两行实数数据分别作为一
+ * 个复数序列的实部与虚部, 只做一次复数FFT, 再利用共轭对称性拆分出两
+ * 行各自的频谱, 行变换的计算量因此减半.
+ * 列变换时把整行看作一个向量, 所有列的蝶形运算在同一个循环内连续完成,
+ * 访存连续, 便于编译器向量化.
+ *
+ * 频谱按行优先存储, 实部与虚部交错排列, 与OpenCV中CV_32FC2格式一致.
+ * 由于输入为实数, 频谱满足共轭对称性F(u, v) = conj(F(-u, -v)), 因此还
+ * 提供了只保留每行前width/2+1列的"半频谱"变换, 其余列可由对称性恢复,
+ * 在频域中逐元素运算的数据量与计算量都因此减半.
+ *
+ * 此外还提供了相关滤波核函数中多通道频谱"共轭相乘再求和"的融合运算,
+ * 根据编译选项自动选择AVX2, SSE2或标量实现, 以及在频域中完成循环平移的
+ * 相位旋转, 整数平移量的旋转因子直接取自FFT_Plan.
+ */
+
+#ifndef FFT_H
+#define FFT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif //__cplusplus
+
+#define FFT_PI 3.14159265358979323846
+
+typedef struct FFT_Plan
+{
+    int width;          //变换宽度(列数), 须为2的整数次幂
+    int height;         //变换高度(行数), 须为2的整数次幂
+    int *colRev;        //行内(长度为width)变换的位反转表
+    int *rowRev;        //列向(长度为height)变换的位反转表
+    float *colTwiddle;  //长度为width的变换的旋转因子, cos与-sin交错存放
+    float *rowTwiddle;  //长度为height的变换的旋转因子, cos与-sin交错存放
+    float *buf;         //工作缓存, width*(height+1)个复数
+} FFT_Plan;
+
+FFT_Plan* newFftPlan(int width, int height);
+
+void freeFftPlan(FFT_Plan *plan);
+
+void fft2dReal(FFT_Plan *plan, const float *src, float *dst, int channels);
+
+void ifft2dReal(FFT_Plan *plan, const float *src, float *dst);
+
+void fft2dRealHalf(FFT_Plan *plan, const float *src, float *dst, int channels);
+
+void ifft2dRealHalf(FFT_Plan *plan, const float *src, float *dst);
+
+int getFftHalfWidth(const FFT_Plan *plan);
+
+void mulSpectrumsConjSum(const float *a, const float *b, float *dst, int n, int channels);
+
+void shiftSpectrum(const FFT_Plan *plan, float *spec, int cols, int channels, float dx, float dy);
+
+#ifdef __cplusplus
+}
+#endif //__cplusplus
+
+#endif // FFT_H
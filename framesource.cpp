@@ -0,0 +1,440 @@
+#include <stdio.h>
+#include <assert.h>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include "framesource.h"
+#include "alloccount.h"
+
+using namespace std;
+using namespace cv;
+
+/**
+ * @brief 图像序列解码使用的imdecode标志
+ * @param mode 解码方式
+ * @param reduction 缩小倍数
+ * @return 标志; OpenCV 3.1之前没有IMREAD_REDUCED_*, 缩小由decodeFile在解码后完成
+ */
+static int getDecodeFlags(int mode, int reduction)
+{
+    bool gray = (mode == FRAME_DECODE_GRAY);
+#if CV_VERSION_MAJOR > 3 || (CV_VERSION_MAJOR == 3 && CV_VERSION_MINOR >= 1)
+    switch(reduction)
+    {
+    case 2:
+        return gray ? IMREAD_REDUCED_GRAYSCALE_2 : IMREAD_REDUCED_COLOR_2;
+    case 4:
+        return gray ? IMREAD_REDUCED_GRAYSCALE_4 : IMREAD_REDUCED_COLOR_4;
+    case 8:
+        return gray ? IMREAD_REDUCED_GRAYSCALE_8 : IMREAD_REDUCED_COLOR_8;
+    }
+#else
+    (void)reduction;
+#endif
+    return gray ? IMREAD_GRAYSCALE : IMREAD_COLOR;
+}
+
+/**
+ * @brief 构造帧源
+ * @param slots 视频与摄像头使用的帧缓存个数, 至少为2(跟踪线程持有一帧时,
+ * 解码线程仍有缓存可写). 图像序列的缓存个数由openSequence确定
+ */
+FrameSource::FrameSource(int slots)
+{
+    assert(slots >= 2);
+    this->slots = slots;
+    ring.resize(slots);
+    ringIndex.resize(slots, -1);
+    heldSlot = -1;
+    policy = FRAME_POLICY_BLOCK;
+    frameCount = 0;
+    decoded = 0;
+    dropped = 0;
+    nextFile = 0;
+    nextDeliver = 0;
+    memoryLimit = FRAME_SOURCE_DEFAULT_MEMORY;
+    decodeMode = FRAME_DECODE_COLOR;
+    reduction = 1;
+    ordered = false;
+    opened = false;
+    running = false;
+    endOfStream = true;
+}
+
+FrameSource::~FrameSource()
+{
+    close();
+}
+
+bool FrameSource::openCamera(int deviceId, int policy)
+{
+    close();
+    video.open(deviceId);
+    if(!video.isOpened())
+        return false;
+    frameCount = -1;
+    ring.resize(slots);
+    ringIndex.assign(slots, -1);
+    start(policy, 1);
+    return true;
+}
+
+bool FrameSource::openVideo(const string &fileName, int policy)
+{
+    close();
+    video.open(fileName);
+    if(!video.isOpened())
+        return false;
+    frameCount = (int)video.get(CAP_PROP_FRAME_COUNT);
+    ring.resize(slots);
+    ringIndex.assign(slots, -1);
+    start(policy, 1);
+    return true;
+}
+
+/**
+ * @brief 打开图像序列, 由多个线程并行预取之后的若干帧
+ * @param fileNames 按播放顺序排列的文件列表
+ * @param prefetch 预取的帧数(缓存个数), 实际取值还受内存上限约束, 至少为2
+ * @param threads 解码线程数, 小于等于0时取CPU核数减1
+ * @return 第一帧无法解码时返回false
+ * 第一帧在本函数中同步解码, 用于估算每个缓存的大小.
+ */
+bool FrameSource::openSequence(const vector<string> &fileNames, int prefetch, int threads)
+{
+    close();
+    if(fileNames.empty())
+        return false;
+    vector<uchar> fileBuf;
+    Mat first;
+    if(!decodeFile(fileNames[0], fileBuf, first))
+        return false;
+    size_t frameBytes = MAX(first.total() * first.elemSize(), (size_t)1);
+    size_t k = MIN((size_t)MAX(prefetch, 2), MAX(memoryLimit / frameBytes, (size_t)2));
+    k = MIN(k, fileNames.size() + 1);
+    files = fileNames;
+    frameCount = (int)files.size();
+    ring.resize(k);
+    ringIndex.assign(k, -1);
+    ring[0] = first;
+    ringIndex[0] = 0;
+    ordered = true;
+    if(threads <= 0)
+        threads = MAX(getNumberOfCPUs() - 1, 1);
+    start(FRAME_POLICY_BLOCK, MIN(threads, (int)k));
+    return true;
+}
+
+/**
+ * @brief 停止解码线程并关闭视频, 帧缓存保留, 重新打开时继续使用
+ */
+void FrameSource::close()
+{
+    {
+        unique_lock<mutex> guard(lock);
+        running = false;
+    }
+    slotFree.notify_all();
+    frameReady.notify_all();
+    for(size_t i = 0; i < workers.size(); i++)
+        workers[i].join();
+    workers.clear();
+    if(video.isOpened())
+        video.release();
+    files.clear();
+    freeSlots.clear();
+    readySlots.clear();
+    heldSlot = -1;
+    frameCount = 0;
+    ordered = false;
+    opened = false;
+    endOfStream = true;
+}
+
+/**
+ * @brief 是否已打开视频, 摄像头或图像序列. 播放结束后仍为true, 直到close
+ */
+bool FrameSource::isOpened() const
+{
+    return opened;
+}
+
+/**
+ * @brief 设置图像序列预取的内存上限, 在下一次openSequence时生效
+ * @param bytes 全部帧缓存的总字节数
+ */
+void FrameSource::setMemoryLimit(size_t bytes)
+{
+    memoryLimit = bytes;
+}
+
+/**
+ * @brief 设置图像序列的解码方式, 在下一次openSequence时生效, 对视频与摄像头无效
+ * @param mode FRAME_DECODE_COLOR解码为BGR图像, FRAME_DECODE_GRAY直接解码为灰度图像
+ * @param reduction 缩小倍数, 1, 2, 4或8
+ */
+void FrameSource::setDecodeMode(int mode, int reduction)
+{
+    assert(mode == FRAME_DECODE_COLOR || mode == FRAME_DECODE_GRAY);
+    assert(reduction == 1 || reduction == 2 || reduction == 4 || reduction == 8);
+    decodeMode = mode;
+    this->reduction = reduction;
+}
+
+/**
+ * @brief 取出下一帧, 没有可用的帧时等待. 视频按解码顺序交付, 图像序列按文件
+ * 顺序交付; 实时模式(FRAME_POLICY_LATEST)交付最新解码的帧, 更早的未处理帧
+ * 直接归还给解码线程并计入丢帧数
+ * @param frame 输出的帧, 与帧缓存共享数据, 在release之前有效
+ * @param frameIndex 输出该帧的序号(从0开始), 可为NULL
+ * @return 已结束且没有剩余的帧, 或该帧解码失败时返回false
+ */
+bool FrameSource::acquire(Mat &frame, int *frameIndex)
+{
+    release();
+    unique_lock<mutex> guard(lock);
+    int pos;
+    while((pos = findReadySlot()) < 0 && !endOfStream)
+        frameReady.wait(guard);
+    if(pos < 0)
+    {
+        frame.release();
+        return false;
+    }
+    heldSlot = readySlots[pos];
+    readySlots.erase(readySlots.begin() + pos);
+    if(!ordered && policy == FRAME_POLICY_LATEST && pos > 0)
+    {
+        for(int i = 0; i < pos; i++)
+            freeSlots.push_back(readySlots[i]);
+        readySlots.erase(readySlots.begin(), readySlots.begin() + pos);
+        dropped += pos;
+        slotFree.notify_all();
+    }
+    if(ordered)
+    {
+        nextDeliver++;
+        endOfStream = (nextDeliver >= (int)files.size());
+    }
+    frame = ring[heldSlot];
+    if(frameIndex)
+        *frameIndex = ringIndex[heldSlot];
+    return !frame.empty();
+}
+
+/**
+ * @brief 归还acquire取得的帧, 之后解码线程可以改写该帧缓存
+ */
+void FrameSource::release()
+{
+    {
+        unique_lock<mutex> guard(lock);
+        if(heldSlot < 0)
+            return;
+        freeSlots.push_back(heldSlot);
+        heldSlot = -1;
+    }
+    slotFree.notify_one();
+}
+
+/**
+ * @brief 总帧数, 摄像头返回-1, 未打开时返回0.
+ * 解码线程运行期间不能访问VideoCapture, 因此返回打开时确定的值
+ */
+int FrameSource::getFrameCount()
+{
+    return frameCount;
+}
+
+int FrameSource::getDroppedCount()
+{
+    unique_lock<mutex> guard(lock);
+    return dropped;
+}
+
+/**
+ * @brief 解码视频的一帧, 在解码线程中调用. 帧尺寸不变时直接写入原有的缓存
+ */
+bool FrameSource::decodeFrame(Mat &frame)
+{
+    return video.read(frame) && !frame.empty();
+}
+
+/**
+ * @brief 读取并解码一个图像文件, 在解码线程中调用, 解码方式见setDecodeMode
+ * @param fileName 文件名
+ * @param fileBuf 文件数据的缓存, 由各线程重复使用
+ * @param frame 输出的图像, 尺寸不变时直接写入原有的缓存
+ */
+bool FrameSource::decodeFile(const string &fileName, vector<uchar> &fileBuf, Mat &frame)
+{
+    FILE *fp = fopen(fileName.c_str(), "rb");
+    if(fp == NULL)
+        return false;
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    if(size <= 0)
+    {
+        fclose(fp);
+        return false;
+    }
+    fileBuf.resize(size);
+    size_t n = fread(&fileBuf[0], 1, size, fp);
+    fclose(fp);
+    if(n != (size_t)size)
+        return false;
+    int flags = getDecodeFlags(decodeMode, reduction);
+#if CV_VERSION_MAJOR > 3 || (CV_VERSION_MAJOR == 3 && CV_VERSION_MINOR >= 1)
+    imdecode(fileBuf, flags, &frame);
+#else
+    if(reduction == 1)
+        imdecode(fileBuf, flags, &frame);
+    else
+    {
+        Mat full = imdecode(fileBuf, flags);
+        if(!full.empty())
+            resize(full, frame, Size((full.cols + reduction - 1) / reduction, (full.rows + reduction - 1) / reduction),
+                   0, 0, INTER_AREA);
+        else
+            frame.release();
+    }
+#endif
+    return !frame.empty();
+}
+
+/**
+ * @brief 启动解码线程. 图像序列中已同步解码的第一帧(缓存0)直接进入待处理队列
+ * @param policy 缓存满时的策略
+ * @param threads 解码线程数, 视频与摄像头只能为1
+ */
+void FrameSource::start(int policy, int threads)
+{
+    this->policy = policy;
+    freeSlots.clear();
+    readySlots.clear();
+    int first = 0;
+    if(ordered)
+    {
+        readySlots.push_back(0);
+        first = 1;
+    }
+    for(int i = first; i < (int)ring.size(); i++)
+        freeSlots.push_back(i);
+    heldSlot = -1;
+    decoded = first;
+    dropped = 0;
+    nextFile = first;
+    nextDeliver = 0;
+    endOfStream = false;
+    opened = true;
+    running = true;
+    for(int i = 0; i < threads; i++)
+        workers.push_back(thread(ordered ? &FrameSource::sequenceLoop : &FrameSource::decodeLoop, this));
+}
+
+/**
+ * @brief 查找下一个可交付的缓存, 须在持有锁时调用. 实时模式取最新的一帧,
+ * 视频取最早的一帧, 图像序列取文件顺序上的下一帧
+ * @return 在待处理队列中的位置, 没有时返回-1
+ */
+int FrameSource::findReadySlot()
+{
+    if(readySlots.empty())
+        return -1;
+    if(!ordered)
+        return (policy == FRAME_POLICY_LATEST) ? (int)readySlots.size() - 1 : 0;
+    for(size_t i = 0; i < readySlots.size(); i++)
+        if(ringIndex[readySlots[i]] == nextDeliver)
+            return (int)i;
+    return -1;
+}
+
+/**
+ * @brief 视频解码线程: 取得一个空闲缓存, 在锁外解码, 再放入待处理队列
+ */
+void FrameSource::decodeLoop()
+{
+    setAllocCountIgnored(true); //解码分配的帧不计入跟踪器的内存分配检查
+    while(1)
+    {
+        int slot;
+        {
+            unique_lock<mutex> guard(lock);
+            while(running && freeSlots.empty() && policy == FRAME_POLICY_BLOCK)
+                slotFree.wait(guard);
+            if(!running)
+                break;
+            if(!freeSlots.empty())
+            {
+                slot = freeSlots.front();
+                freeSlots.pop_front();
+            }
+            else
+            {
+                //实时模式下丢弃最早的未处理帧, 至少有2个缓存, 因此待处理队列不为空
+                assert(!readySlots.empty());
+                slot = readySlots.front();
+                readySlots.pop_front();
+                dropped++;
+            }
+        }
+        bool ok = decodeFrame(ring[slot]);
+        {
+            unique_lock<mutex> guard(lock);
+            if(ok)
+            {
+                ringIndex[slot] = decoded++;
+                readySlots.push_back(slot);
+            }
+            else
+            {
+                freeSlots.push_back(slot);
+                endOfStream = true;
+            }
+        }
+        frameReady.notify_one();
+        if(!ok)
+            break;
+    }
+    unique_lock<mutex> guard(lock);
+    endOfStream = true;
+    frameReady.notify_all();
+}
+
+/**
+ * @brief 图像序列解码线程: 按文件顺序领取下一个文件与一个空闲缓存, 在锁外
+ * 读取并解码. 交付顺序由acquire保证, 各线程可以乱序完成.
+ * 下一帧要么已在待处理队列中, 要么正被某个线程解码, 因此不会死锁
+ */
+void FrameSource::sequenceLoop()
+{
+    vector<uchar> fileBuf;
+    setAllocCountIgnored(true);
+    while(1)
+    {
+        int slot, idx;
+        {
+            unique_lock<mutex> guard(lock);
+            while(running && freeSlots.empty() && nextFile < (int)files.size())
+                slotFree.wait(guard);
+            if(!running || nextFile >= (int)files.size())
+                break;
+            slot = freeSlots.front();
+            freeSlots.pop_front();
+            idx = nextFile++;
+        }
+        if(!decodeFile(files[idx], fileBuf, ring[slot]))
+        {
+            fprintf(stderr, "FrameSource: cannot decode %s\n", files[idx].c_str());
+            ring[slot].release(); //交付空帧, acquire返回false
+        }
+        {
+            unique_lock<mutex> guard(lock);
+            ringIndex[slot] = idx;
+            readySlots.push_back(slot);
+            decoded++;
+        }
+        frameReady.notify_all();
+    }
+}
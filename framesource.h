@@ -0,0 +1,102 @@
+#ifndef FRAMESOURCE_H
+#define FRAMESOURCE_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <opencv2/core.hpp>
+#include <opencv2/videoio.hpp>
+
+/*
+ * 后台解码的帧源.
+ * 解码在独立线程中进行, 解码结果写入预先分配的N个帧缓存(环形使用),
+ * 跟踪线程通过acquire取得最早的一帧, 处理完毕后release归还, 期间该帧缓存
+ * 不会被解码线程改写, 因此取帧不需要拷贝. 解码与跟踪由此重叠执行.
+ * 缓存全部被占用时有两种策略:
+ *   FRAME_POLICY_BLOCK  解码线程等待跟踪线程归还缓存, 不丢帧, 用于视频文件;
+ *   FRAME_POLICY_LATEST 丢弃最早的未处理帧, 用于实时摄像头. 此外acquire总是
+ *                       交付最新解码的帧, 并丢弃在此之前所有未处理的帧.
+ * 图像序列由多个解码线程并行预取之后的K帧, 各线程按文件顺序领取任务,
+ * 完成顺序可能不同, acquire仍按文件顺序交付. K受内存上限约束: 以第一帧的
+ * 大小估算每个缓存的占用, 缓存总量不超过setMemoryLimit设定的字节数.
+ * 图像序列可以直接解码为灰度图像(FRAME_DECODE_GRAY), 跟踪器只使用灰度, 省去
+ * 色度上采样与颜色转换; 还可以按1/2, 1/4, 1/8缩小解码, JPEG在DCT域直接缩小,
+ * 只解码低频系数. 缩小后的帧坐标是原图的1/reduction, 由调用者换算. 带界面
+ * 显示时仍按彩色解码.
+ * 同一时刻跟踪线程最多持有一帧, 调用acquire前须release上一帧(acquire会自动
+ * 归还尚未release的帧).
+ */
+
+#define FRAME_POLICY_BLOCK  0
+#define FRAME_POLICY_LATEST 1
+
+#define FRAME_DECODE_COLOR  0
+#define FRAME_DECODE_GRAY   1
+
+#define FRAME_SOURCE_DEFAULT_SLOTS 4
+#define FRAME_SOURCE_DEFAULT_PREFETCH 8          //图像序列默认预取的帧数
+#define FRAME_SOURCE_DEFAULT_MEMORY (256 << 20)  //图像序列预取的默认内存上限(字节)
+
+class FrameSource
+{
+public:
+    FrameSource(int slots = FRAME_SOURCE_DEFAULT_SLOTS);
+    virtual ~FrameSource();
+
+    virtual bool openCamera(int deviceId, int policy = FRAME_POLICY_LATEST);
+    virtual bool openVideo(const std::string &fileName, int policy = FRAME_POLICY_BLOCK);
+    virtual bool openSequence(const std::vector<std::string> &fileNames,
+                              int prefetch = FRAME_SOURCE_DEFAULT_PREFETCH, int threads = 0);
+    virtual void close();
+    virtual bool isOpened() const;
+    virtual void setMemoryLimit(size_t bytes);
+    virtual void setDecodeMode(int mode, int reduction = 1);
+
+    virtual bool acquire(cv::Mat &frame, int *frameIndex = NULL);
+    virtual void release();
+
+    virtual int getFrameCount();
+    virtual int getDroppedCount();
+
+protected:
+    virtual bool decodeFrame(cv::Mat &frame);
+    virtual bool decodeFile(const std::string &fileName, std::vector<uchar> &fileBuf, cv::Mat &frame);
+
+private:
+    void start(int policy, int threads);
+    void decodeLoop();
+    void sequenceLoop();
+    int findReadySlot();
+
+    cv::VideoCapture video;
+    std::vector<std::string> files;     //图像序列的文件列表
+    std::vector<cv::Mat> ring;          //帧缓存
+    std::vector<int> ringIndex;         //各缓存中帧的序号
+    std::deque<int> freeSlots;          //空闲的缓存
+    std::deque<int> readySlots;         //已解码, 等待处理的缓存, 按完成顺序排列
+    int slots;                          //视频与摄像头使用的缓存个数
+    int heldSlot;                       //跟踪线程正在处理的缓存, -1表示没有
+    int policy;
+    int frameCount;                     //总帧数, 在打开时确定, 摄像头为-1
+    int decoded;                        //已解码的帧数
+    int dropped;                        //实时模式下被丢弃(被覆盖或被跳过)的帧数
+    int nextFile;                       //图像序列中下一个待领取的文件
+    int nextDeliver;                    //图像序列中下一个应交付的帧
+    size_t memoryLimit;
+    int decodeMode;                     //图像序列的解码方式, FRAME_DECODE_COLOR或FRAME_DECODE_GRAY
+    int reduction;                      //图像序列的缩小倍数, 1, 2, 4或8
+    bool ordered;                       //是否按帧序号交付(图像序列)
+    bool opened;
+    bool running;
+    bool endOfStream;
+
+    std::vector<std::thread> workers;
+    std::mutex lock;
+    std::condition_variable frameReady; //有新帧或解码结束
+    std::condition_variable slotFree;   //有空闲缓存或需要退出
+};
+
+#endif // FRAMESOURCE_H
@@ -0,0 +1,733 @@
+/*
+ * fsct_bench: 无界面的跟踪性能与精度测试程序.
+ * 读取OTB格式的序列目录(img目录下的jpg图像与groundtruth_rect.txt), 以第一帧的真值
+ * 初始化跟踪器, 之后逐帧调用trackEachFrame, 不做任何显示. 结果以JSON格式
+ * 输出, 包括FPS, 单帧耗时分布, 中心误差精度(20像素)与重叠率成功率曲线下面积.
+ * 计时只包括initTarget与trackEachFrame, 不包括图像解码. 图像由FrameSource在后台
+ * 线程中并行预取, 跟踪线程等待解码的时间单独记为wait_ms, 该值接近0时说明
+ * 测试受限于跟踪器而不是解码.
+ *
+ * 用法: fsct_bench [选项] <序列目录> [<序列目录> ...]
+ *   --half          使用半频谱相关
+ *   --reuse         训练样本复用检测样本的频谱
+ *   --no-scale      关闭尺度估计
+ *   --area          图像块采样使用区域插值(默认双线性插值)
+ *   --parallel      平移与尺度分支并行训练
+ *   --parallel-hog  HOG特征按行带并行提取
+ *   --patt N        平移与尺度的模板尺寸, 默认32
+ *   --threads N[,N...]  OpenCV线程数; 给出多个值(如1,2,4,8)时依次以各线程数运行
+ *                   全部序列, 输出为各次结果组成的JSON数组
+ *   --targets N     同时跟踪N个目标(MultiTracker): 第一个为真值框, 其余在其
+ *                   周围随机平移, 输出目标帧吞吐量与单目标耗时; 精度只统计第一个
+ *   --prefetch K    预取的帧数, 默认8
+ *   --decode-threads N  解码线程数, 默认为CPU核数减1
+ *   --mem-limit MB  预取缓存的内存上限, 默认256MB
+ *   --gray          直接解码为灰度图像
+ *   --reduce N      按1/N缩小解码(N为1, 2, 4, 8或auto), 真值与结果按原图坐标换算.
+ *                   auto按第一帧目标的大小选取, 保证搜索窗口不小于归一化图像块
+ *   --frames        输出每一帧的耗时, 中心误差与重叠率
+ *   --profile       输出各阶段的耗时统计
+ *   --alloc-check   检查跟踪过程中没有分配内存: 第二帧起每帧新分配的Mat缓存数
+ *                   须为0且工作空间地址不变, 否则断言失败退出
+ *   --baseline      另以默认参数(见setDefaultParam)运行同样的序列, 每个序列与总体
+ *                   结果中给出默认参数的fps, 精度与AUC及当前参数相对它的差值,
+ *                   用于检查--reuse, --half等选项对精度与速度的影响
+ *   --output FILE   JSON写入FILE, 默认写到标准输出
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <algorithm>
+#include <opencv2/core.hpp>
+
+#include "corrtrack.h"
+#include "multitrack.h"
+
+using namespace std;
+using namespace cv;
+
+#define PRECISION_THRESHOLD 20  //中心误差精度的像素阈值
+#define SUCCESS_STEPS 21        //成功率曲线的重叠率阈值为0:0.05:1
+
+typedef struct SeqResult
+{
+    string name;
+    int frames;                 //参与评估的帧数(含初始化帧)
+    int reduction;              //解码的缩小倍数
+    double initMs;              //initTarget耗时
+    double waitMs;              //跟踪线程等待解码的总时间
+    vector<double> latency;     //各帧trackEachFrame耗时(ms), 不含初始化帧
+    vector<double> centerError; //各帧中心误差(像素), 真值无效的帧为-1
+    vector<double> overlap;     //各帧重叠率, 真值无效的帧为-1
+    bool profiled;              //是否统计了各阶段耗时
+    StageStats stages[STAGE_COUNT];
+    int targets;                //同时跟踪的目标数
+    double targetThroughput;    //每秒跟踪的目标帧数
+    double targetMeanMs;        //单目标单帧的平均耗时
+    double targetMaxMs;         //单目标单帧的最大耗时
+} SeqResult;
+
+typedef struct LoadParam
+{
+    int prefetch;       //预取的帧数
+    int threads;        //解码线程数, 0表示自动
+    size_t memoryLimit; //预取缓存的内存上限(字节)
+    int decodeMode;     //FRAME_DECODE_COLOR或FRAME_DECODE_GRAY
+    int reduction;      //缩小倍数, 0表示自动选取
+} LoadParam;
+
+static void setDefaultParam(TrackParam *param)
+{
+    param->transPad = 1.5;
+    param->transPattSz = 32;
+    param->transCellSz = 4;
+    param->transGaussSigmaRate = 24;
+    param->transLearnRate = 0.02;
+    param->useScale = true;
+    param->scaleMinRhoCoef = 0.2;
+    param->scalePattSz = 32;
+    param->scaleCellSz = 4;
+    param->scaleGaussSigmaRate = 28;
+    param->scaleLearnRate = 0.02;
+    param->useHalfSpectrum = false;
+    param->reuseFeatures = false;
+    param->sampleMethod = RS_BILINEAR;
+    param->parallelBranches = false;
+    param->parallelHog = false;
+}
+
+static string joinPath(const string &dir, const string &name)
+{
+    if(dir.empty())
+        return name;
+    char last = dir[dir.length() - 1];
+    if(last == '/' || last == '\\')
+        return dir + name;
+    return dir + "/" + name;
+}
+
+static string baseName(const string &dir)
+{
+    string path = dir;
+    while(path.length() > 1 && (path[path.length() - 1] == '/' || path[path.length() - 1] == '\\'))
+        path.erase(path.length() - 1);
+    size_t pos = path.find_last_of("/\\");
+    return (pos == string::npos) ? path : path.substr(pos + 1);
+}
+
+/**
+ * @brief 读取groundtruth_rect.txt, 分隔符可为逗号, 空格或制表符
+ * @param path 真值文件路径
+ * @param gt 输出的真值框
+ * @return 读取成功返回true
+ */
+static bool readGroundTruth(const string &path, vector<Rect> &gt)
+{
+    ifstream fs(path.c_str());
+    if(!fs.is_open())
+        return false;
+    string line;
+    gt.clear();
+    while(getline(fs, line))
+    {
+        for(size_t i = 0; i < line.length(); i++)
+            if(line[i] == ',' || line[i] == '\t')
+                line[i] = ' ';
+        double x, y, w, h;
+        if(sscanf(line.c_str(), "%lf %lf %lf %lf", &x, &y, &w, &h) != 4)
+            continue;
+        gt.push_back(Rect(cvRound(x), cvRound(y), cvRound(w), cvRound(h)));
+    }
+    return !gt.empty();
+}
+
+static double centerError(const Rect &a, const Rect &b)
+{
+    double dx = (a.x + a.width * 0.5) - (b.x + b.width * 0.5);
+    double dy = (a.y + a.height * 0.5) - (b.y + b.height * 0.5);
+    return sqrt(dx * dx + dy * dy);
+}
+
+static double overlapRatio(const Rect &a, const Rect &b)
+{
+    double inter = (a & b).area();
+    double uni = (double)a.area() + b.area() - inter;
+    return (uni > 0) ? inter / uni : 0;
+}
+
+static Rect scaleRect(const Rect &r, double s)
+{
+    return Rect(cvRound(r.x * s), cvRound(r.y * s), cvRound(r.width * s), cvRound(r.height * s));
+}
+
+/**
+ * @brief 选取最大的缩小倍数, 使缩小后的搜索窗口仍不小于两个分支的归一化图像块,
+ * 即缩小不损失特征的分辨率
+ * @param param 跟踪参数
+ * @param target 第一帧的目标(原图坐标)
+ * @return 1, 2, 4或8
+ */
+static int chooseReduction(TrackParam *param, const Rect &target)
+{
+    double win = MIN(target.width, target.height) * (param->transPad + 1);
+    int normSz = param->transPattSz * param->transCellSz;
+    if(param->useScale)
+        normSz = MAX(normSz, param->scalePattSz * param->scaleCellSz);
+    int r = 8;
+    while(r > 1 && win / r < normSz)
+        r /= 2;
+    return r;
+}
+
+/**
+ * @brief 生成多目标测试的目标框: 第一个为真值框, 其余在其周围随机平移至多
+ * 半个目标尺寸, 并限制在帧内. 随机数种子固定, 结果可重复
+ * @param target 真值框
+ * @param n 目标数
+ * @param frameSz 帧尺寸
+ * @param rects 输出的目标框
+ */
+static void makeTargets(const Rect &target, int n, const Size &frameSz, vector<Rect> &rects)
+{
+    RNG rng(0x5eed);
+    rects.assign(1, target);
+    for(int i = 1; i < n; i++)
+    {
+        Rect r = target;
+        r.x += cvRound(rng.uniform(-0.5, 0.5) * target.width);
+        r.y += cvRound(rng.uniform(-0.5, 0.5) * target.height);
+        r.x = MIN(MAX(r.x, 0), MAX(frameSz.width - r.width, 0));
+        r.y = MIN(MAX(r.y, 0), MAX(frameSz.height - r.height, 0));
+        rects.push_back(r);
+    }
+}
+
+/**
+ * @brief 对已排序的数据取百分位数(线性插值)
+ */
+static double percentile(const vector<double> &sorted, double p)
+{
+    if(sorted.empty())
+        return 0;
+    double pos = p * (sorted.size() - 1);
+    size_t lo = (size_t)floor(pos);
+    size_t hi = MIN(lo + 1, sorted.size() - 1);
+    return sorted[lo] + (sorted[hi] - sorted[lo]) * (pos - lo);
+}
+
+/**
+ * @brief 中心误差不超过PRECISION_THRESHOLD像素的帧所占比例
+ */
+static double getPrecision(const SeqResult &res)
+{
+    int n = 0, hit = 0;
+    for(size_t i = 0; i < res.centerError.size(); i++)
+    {
+        if(res.centerError[i] < 0)
+            continue;
+        n++;
+        if(res.centerError[i] <= PRECISION_THRESHOLD)
+            hit++;
+    }
+    return (n > 0) ? (double)hit / n : 0;
+}
+
+/**
+ * @brief 成功率曲线下面积, 即重叠率阈值取0:0.05:1时各成功率的均值
+ */
+static double getSuccessAuc(const SeqResult &res)
+{
+    int n = 0;
+    double auc = 0;
+    for(size_t i = 0; i < res.overlap.size(); i++)
+        if(res.overlap[i] >= 0)
+            n++;
+    if(n == 0)
+        return 0;
+    for(int k = 0; k < SUCCESS_STEPS; k++)
+    {
+        double th = (double)k / (SUCCESS_STEPS - 1);
+        int hit = 0;
+        for(size_t i = 0; i < res.overlap.size(); i++)
+            if(res.overlap[i] >= 0 && res.overlap[i] > th)
+                hit++;
+        auc += (double)hit / n;
+    }
+    return auc / SUCCESS_STEPS;
+}
+
+static double getTotalMs(const SeqResult &res)
+{
+    double total = 0;
+    for(size_t i = 0; i < res.latency.size(); i++)
+        total += res.latency[i];
+    return total;
+}
+
+/**
+ * @brief 跟踪一个序列
+ * @param dir 序列目录
+ * @param param 跟踪参数
+ * @param load 图像预取参数
+ * @param profile 是否统计各阶段耗时, 多目标时不统计
+ * @param targets 同时跟踪的目标数, 大于1时使用MultiTracker
+ * @param allocCheck 是否检查跟踪过程中的内存分配, 见CorrTrack::setAllocCheck
+ * @param res 输出的测试结果
+ * @return 序列无法读取时返回false
+ */
+static bool runSequence(const string &dir, TrackParam *param, const LoadParam &load, bool profile, int targets,
+                        bool allocCheck, SeqResult &res)
+{
+    vector<String> files;
+    vector<Rect> gt;
+    if(!readGroundTruth(joinPath(dir, "groundtruth_rect.txt"), gt))
+    {
+        fprintf(stderr, "fsct_bench: cannot read ground truth in %s\n", dir.c_str());
+        return false;
+    }
+    glob(joinPath(joinPath(dir, "img"), "*.jpg"), files, false);
+    int n = (int)MIN(files.size(), gt.size());
+    if(n == 0)
+    {
+        fprintf(stderr, "fsct_bench: no images in %s\n", dir.c_str());
+        return false;
+    }
+    vector<string> fileNames(files.begin(), files.begin() + n);
+    int reduction = load.reduction > 0 ? load.reduction : chooseReduction(param, gt[0]);
+    FrameSource source;
+    source.setMemoryLimit(load.memoryLimit);
+    source.setDecodeMode(load.decodeMode, reduction);
+    if(!source.openSequence(fileNames, load.prefetch, load.threads))
+    {
+        fprintf(stderr, "fsct_bench: cannot decode %s\n", fileNames[0].c_str());
+        return false;
+    }
+    res.name = baseName(dir);
+    res.frames = n;
+    res.waitMs = 0;
+    res.reduction = reduction;
+    res.latency.clear();
+    res.centerError.assign(n, -1);
+    res.overlap.assign(n, -1);
+
+    double tickToMs = 1000.0 / getTickFrequency();
+    bool multiTarget = targets > 1;
+    CorrTrack tracker(param);
+    MultiTracker multi(param);
+    vector<Rect> rects;
+    tracker.setProfiling(profile && !multiTarget);
+    tracker.setAllocCheck(allocCheck && !multiTarget);
+    multi.setAllocCheck(allocCheck && multiTarget);
+    Mat frame;
+    source.acquire(frame);
+    //跟踪在缩小后的坐标系中进行, 评估时换算回原图坐标
+    Rect rect = scaleRect(gt[0], 1.0 / reduction);
+    int64 t = getTickCount();
+    if(multiTarget)
+    {
+        makeTargets(rect, targets, frame.size(), rects);
+        multi.addTargets(frame, rects);
+    }
+    else
+        tracker.initTarget(frame, rect);
+    res.initMs = (getTickCount() - t) * tickToMs;
+    res.centerError[0] = 0;
+    res.overlap[0] = 1;
+    for(int i = 1; i < n; i++)
+    {
+        t = getTickCount();
+        bool ok = source.acquire(frame);
+        res.waitMs += (getTickCount() - t) * tickToMs;
+        if(!ok)
+        {
+            fprintf(stderr, "fsct_bench: cannot decode %s\n", files[i].c_str());
+            res.frames = i;
+            res.centerError.resize(i);
+            res.overlap.resize(i);
+            break;
+        }
+        t = getTickCount();
+        if(multiTarget)
+        {
+            multi.trackEachFrame(frame, rects);
+            rect = rects[0];
+        }
+        else
+            tracker.trackEachFrame(frame, rect);
+        res.latency.push_back((getTickCount() - t) * tickToMs);
+        //OTB中目标不可见的帧真值为0或负值, 不参与精度统计
+        if(gt[i].width > 0 && gt[i].height > 0)
+        {
+            Rect full = scaleRect(rect, reduction);
+            res.centerError[i] = centerError(full, gt[i]);
+            res.overlap[i] = overlapRatio(full, gt[i]);
+        }
+    }
+    res.profiled = profile && !multiTarget;
+    for(int k = 0; k < STAGE_COUNT; k++)
+        res.stages[k] = tracker.getProfiler().getStats(k);
+    res.targets = MAX(targets, 1);
+    res.targetMeanMs = 0;
+    res.targetMaxMs = 0;
+    if(multiTarget)
+    {
+        int count = 0;
+        for(int i = 0; i < multi.getTargetCount(); i++)
+        {
+            const TrackLatency &lat = multi.getTargetLatency(i);
+            res.targetMeanMs += lat.total;
+            res.targetMaxMs = MAX(res.targetMaxMs, lat.max);
+            count += lat.count;
+        }
+        res.targetMeanMs = count ? res.targetMeanMs / count : 0;
+        res.targetThroughput = multi.getThroughput();
+    }
+    else
+    {
+        double ms = getTotalMs(res);
+        res.targetThroughput = (ms > 0) ? res.latency.size() * 1000.0 / ms : 0;
+        res.targetMeanMs = res.latency.empty() ? 0 : ms / res.latency.size();
+        for(size_t i = 0; i < res.latency.size(); i++)
+            res.targetMaxMs = MAX(res.targetMaxMs, res.latency[i]);
+    }
+    return true;
+}
+
+static void writeLatency(FILE *fp, const vector<double> &latency, const char *indent)
+{
+    vector<double> sorted(latency);
+    sort(sorted.begin(), sorted.end());
+    double total = 0;
+    for(size_t i = 0; i < sorted.size(); i++)
+        total += sorted[i];
+    double mean = sorted.empty() ? 0 : total / sorted.size();
+    fprintf(fp, "%s\"latency_ms\": {\"mean\": %.4f, \"p50\": %.4f, \"p90\": %.4f, \"p99\": %.4f, \"max\": %.4f}",
+            indent, mean, percentile(sorted, 0.5), percentile(sorted, 0.9), percentile(sorted, 0.99),
+            sorted.empty() ? 0 : sorted.back());
+}
+
+static void writeJsonString(FILE *fp, const string &s)
+{
+    fputc('"', fp);
+    for(size_t i = 0; i < s.length(); i++)
+    {
+        if(s[i] == '"' || s[i] == '\\')
+            fputc('\\', fp);
+        fputc(s[i], fp);
+    }
+    fputc('"', fp);
+}
+
+static double getFps(const SeqResult &res)
+{
+    double ms = getTotalMs(res);
+    return (ms > 0) ? res.latency.size() * 1000.0 / ms : 0;
+}
+
+/**
+ * @brief 写出默认参数的结果及当前参数相对它的差值
+ * @param fp 输出文件
+ * @param fps, precision, auc 当前参数的结果
+ * @param baseFps, basePrecision, baseAuc 默认参数的结果
+ * @param indent 缩进
+ */
+static void writeBaseline(FILE *fp, double fps, double precision, double auc,
+                          double baseFps, double basePrecision, double baseAuc, const char *indent)
+{
+    fprintf(fp, "%s\"baseline\": {\"fps\": %.2f, \"precision_%dpx\": %.4f, \"success_auc\": %.4f},\n",
+            indent, baseFps, PRECISION_THRESHOLD, basePrecision, baseAuc);
+    fprintf(fp, "%s\"delta\": {\"fps\": %.2f, \"precision_%dpx\": %.4f, \"success_auc\": %.4f}",
+            indent, fps - baseFps, PRECISION_THRESHOLD, precision - basePrecision, auc - baseAuc);
+}
+
+/**
+ * @brief 以JSON格式写出测试结果
+ * @param baseline 默认参数的结果, 为NULL时不输出对比
+ */
+static void writeJson(FILE *fp, TrackParam *param, const LoadParam &load, bool allocCheck, vector<SeqResult> &results,
+                      const vector<SeqResult> *baseline, bool perFrame)
+{
+    double basePrecision = 0, baseAuc = 0, baseMs = 0, baseFrames = 0;
+    int baseCount = 0;
+    vector<double> allLatency;
+    double totalMs = 0, precision = 0, auc = 0, targetFrames = 0;
+    fprintf(fp, "{\n");
+    fprintf(fp, "  \"config\": {\"use_scale\": %s, \"half_spectrum\": %s, \"reuse_features\": %s, \"sample\": \"%s\", \"parallel_branches\": %s, \"parallel_hog\": %s, \"threads\": %d,\n"
+                "             \"prefetch\": %d, \"decode_threads\": %d, \"mem_limit_mb\": %d, \"decode\": \"%s\", \"alloc_check\": %s},\n",
+            param->useScale ? "true" : "false", param->useHalfSpectrum ? "true" : "false",
+            param->reuseFeatures ? "true" : "false",
+            param->sampleMethod == RS_AREA ? "area" : "bilinear",
+            param->parallelBranches ? "true" : "false", param->parallelHog ? "true" : "false", getNumThreads(),
+            load.prefetch, load.threads, (int)(load.memoryLimit >> 20),
+            load.decodeMode == FRAME_DECODE_GRAY ? "gray" : "color", allocCheck ? "true" : "false");
+    fprintf(fp, "  \"sequences\": [\n");
+    for(size_t s = 0; s < results.size(); s++)
+    {
+        SeqResult &res = results[s];
+        double ms = getTotalMs(res);
+        double p = getPrecision(res);
+        double a = getSuccessAuc(res);
+        totalMs += ms;
+        targetFrames += (double)res.latency.size() * res.targets;
+        precision += p;
+        auc += a;
+        allLatency.insert(allLatency.end(), res.latency.begin(), res.latency.end());
+        fprintf(fp, "    {\n      \"name\": ");
+        writeJsonString(fp, res.name);
+        fprintf(fp, ",\n      \"frames\": %d,\n", res.frames);
+        fprintf(fp, "      \"reduction\": %d,\n", res.reduction);
+        fprintf(fp, "      \"init_ms\": %.4f,\n", res.initMs);
+        fprintf(fp, "      \"wait_ms\": %.4f,\n", res.waitMs);
+        fprintf(fp, "      \"fps\": %.2f,\n", getFps(res));
+        fprintf(fp, "      \"targets\": %d,\n", res.targets);
+        fprintf(fp, "      \"target_frames_per_s\": %.2f,\n", res.targetThroughput);
+        fprintf(fp, "      \"target_latency_ms\": {\"mean\": %.4f, \"max\": %.4f},\n", res.targetMeanMs, res.targetMaxMs);
+        writeLatency(fp, res.latency, "      ");
+        fprintf(fp, ",\n      \"precision_%dpx\": %.4f,\n", PRECISION_THRESHOLD, p);
+        fprintf(fp, "      \"success_auc\": %.4f", a);
+        //按名称查找默认参数下同一序列的结果, 两次运行读取的序列相同
+        for(size_t b = 0; baseline && b < baseline->size(); b++)
+        {
+            const SeqResult &base = (*baseline)[b];
+            if(base.name != res.name)
+                continue;
+            fprintf(fp, ",\n");
+            writeBaseline(fp, getFps(res), p, a, getFps(base), getPrecision(base), getSuccessAuc(base), "      ");
+            baseMs += getTotalMs(base);
+            baseFrames += base.latency.size();
+            basePrecision += getPrecision(base);
+            baseAuc += getSuccessAuc(base);
+            baseCount++;
+            break;
+        }
+        if(res.profiled)
+        {
+            fprintf(fp, ",\n      \"stages_us\": {");
+            for(int k = 0, first = 1; k < STAGE_COUNT; k++)
+            {
+                const StageStats &st = res.stages[k];
+                if(st.count == 0)
+                    continue;
+                fprintf(fp, "%s\n        \"%s\": {\"frames\": %d, \"mean\": %.2f, \"p50\": %.2f, \"p99\": %.2f, \"max\": %.2f}",
+                        first ? "" : ",", StageProfiler::getStageName(k), st.count, st.meanUs, st.p50Us, st.p99Us, st.maxUs);
+                first = 0;
+            }
+            fprintf(fp, "\n      }");
+        }
+        if(perFrame)
+        {
+            //第0帧为初始化帧, 耗时记为initTarget的耗时
+            fprintf(fp, ",\n      \"per_frame\": [\n");
+            for(int i = 0; i < res.frames; i++)
+            {
+                double lat = (i == 0) ? res.initMs : res.latency[i - 1];
+                fprintf(fp, "        {\"ms\": %.4f, \"center_error\": %.3f, \"iou\": %.4f}%s\n",
+                        lat, res.centerError[i], res.overlap[i], (i + 1 < res.frames) ? "," : "");
+            }
+            fprintf(fp, "      ]");
+        }
+        fprintf(fp, "\n    }%s\n", (s + 1 < results.size()) ? "," : "");
+    }
+    fprintf(fp, "  ],\n");
+    int nSeq = (int)results.size();
+    fprintf(fp, "  \"overall\": {\n");
+    fprintf(fp, "    \"sequences\": %d,\n", nSeq);
+    fprintf(fp, "    \"frames\": %d,\n", (int)allLatency.size());
+    fprintf(fp, "    \"fps\": %.2f,\n", (totalMs > 0) ? allLatency.size() * 1000.0 / totalMs : 0);
+    fprintf(fp, "    \"target_frames_per_s\": %.2f,\n", (totalMs > 0) ? targetFrames * 1000.0 / totalMs : 0);
+    writeLatency(fp, allLatency, "    ");
+    fprintf(fp, ",\n    \"precision_%dpx\": %.4f,\n", PRECISION_THRESHOLD, nSeq ? precision / nSeq : 0);
+    fprintf(fp, "    \"success_auc\": %.4f", nSeq ? auc / nSeq : 0);
+    if(baseline)
+    {
+        fprintf(fp, ",\n");
+        writeBaseline(fp, (totalMs > 0) ? allLatency.size() * 1000.0 / totalMs : 0,
+                      nSeq ? precision / nSeq : 0, nSeq ? auc / nSeq : 0,
+                      (baseMs > 0) ? baseFrames * 1000.0 / baseMs : 0,
+                      baseCount ? basePrecision / baseCount : 0, baseCount ? baseAuc / baseCount : 0, "    ");
+    }
+    fprintf(fp, "\n  }\n}\n");
+}
+
+/**
+ * @brief 依次测试各序列目录, 无法读取的序列不计入结果
+ * @param dirs 序列目录
+ * @param param 跟踪参数
+ * @param load 图像预取参数
+ * @param profile 是否统计各阶段耗时
+ * @param targets 同时跟踪的目标数
+ * @param allocCheck 是否检查跟踪过程中的内存分配
+ * @param results 输出的测试结果
+ */
+static void runSequences(const vector<string> &dirs, TrackParam *param, const LoadParam &load, bool profile,
+                         int targets, bool allocCheck, vector<SeqResult> &results)
+{
+    results.clear();
+    for(size_t i = 0; i < dirs.size(); i++)
+    {
+        SeqResult res;
+        if(runSequence(dirs[i], param, load, profile, targets, allocCheck, res))
+            results.push_back(res);
+    }
+}
+
+/**
+ * @brief 解析逗号分隔的线程数列表, 如"1,2,4,8"
+ * @param arg 命令行参数
+ * @param threads 输出的线程数
+ * @return 列表为空或含有非正数时返回false
+ */
+static bool parseThreadList(const char *arg, vector<int> &threads)
+{
+    threads.clear();
+    while(*arg)
+    {
+        char *end;
+        long n = strtol(arg, &end, 10);
+        if(end == arg || n <= 0 || (*end != ',' && *end != '\0'))
+            return false;
+        threads.push_back((int)n);
+        arg = (*end == ',') ? end + 1 : end;
+    }
+    return !threads.empty();
+}
+
+static void usage()
+{
+    fprintf(stderr, "usage: fsct_bench [--half] [--reuse] [--no-scale] [--area] [--parallel] [--parallel-hog] [--patt N] [--threads N[,N...]] [--targets N]\n"
+                    "                  [--prefetch K] [--decode-threads N] [--mem-limit MB]\n"
+                    "                  [--gray] [--reduce N|auto]\n"
+                    "                  [--frames] [--profile] [--alloc-check] [--baseline] [--output FILE] <sequence dir> [<sequence dir> ...]\n");
+}
+
+int main(int argc, char *argv[])
+{
+    TrackParam param;
+    vector<string> dirs;
+    const char *output = NULL;
+    bool perFrame = false;
+    bool profile = false;
+    bool allocCheck = false;
+    bool compare = false;
+    int targets = 1;
+    vector<int> threadList;
+    LoadParam load;
+    load.prefetch = FRAME_SOURCE_DEFAULT_PREFETCH;
+    load.threads = 0;
+    load.memoryLimit = FRAME_SOURCE_DEFAULT_MEMORY;
+    load.decodeMode = FRAME_DECODE_COLOR;
+    load.reduction = 1;
+    setDefaultParam(&param);
+    for(int i = 1; i < argc; i++)
+    {
+        if(!strcmp(argv[i], "--half"))
+            param.useHalfSpectrum = true;
+        else if(!strcmp(argv[i], "--reuse"))
+            param.reuseFeatures = true;
+        else if(!strcmp(argv[i], "--no-scale"))
+            param.useScale = false;
+        else if(!strcmp(argv[i], "--area"))
+            param.sampleMethod = RS_AREA;
+        else if(!strcmp(argv[i], "--parallel"))
+            param.parallelBranches = true;
+        else if(!strcmp(argv[i], "--parallel-hog"))
+            param.parallelHog = true;
+        else if(!strcmp(argv[i], "--patt") && i + 1 < argc)
+            param.transPattSz = param.scalePattSz = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "--frames"))
+            perFrame = true;
+        else if(!strcmp(argv[i], "--profile"))
+            profile = true;
+        else if(!strcmp(argv[i], "--alloc-check"))
+            allocCheck = true;
+        else if(!strcmp(argv[i], "--threads") && i + 1 < argc)
+        {
+            if(!parseThreadList(argv[++i], threadList))
+            {
+                usage();
+                return 2;
+            }
+        }
+        else if(!strcmp(argv[i], "--targets") && i + 1 < argc)
+            targets = MAX(atoi(argv[++i]), 1);
+        else if(!strcmp(argv[i], "--prefetch") && i + 1 < argc)
+            load.prefetch = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "--decode-threads") && i + 1 < argc)
+            load.threads = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "--mem-limit") && i + 1 < argc)
+            load.memoryLimit = (size_t)atoi(argv[++i]) << 20;
+        else if(!strcmp(argv[i], "--gray"))
+            load.decodeMode = FRAME_DECODE_GRAY;
+        else if(!strcmp(argv[i], "--reduce") && i + 1 < argc)
+        {
+            i++;
+            load.reduction = !strcmp(argv[i], "auto") ? 0 : atoi(argv[i]);
+            if(load.reduction != 0 && load.reduction != 1 && load.reduction != 2 &&
+               load.reduction != 4 && load.reduction != 8)
+            {
+                usage();
+                return 2;
+            }
+        }
+        else if(!strcmp(argv[i], "--baseline"))
+            compare = true;
+        else if(!strcmp(argv[i], "--output") && i + 1 < argc)
+            output = argv[++i];
+        else if(argv[i][0] == '-')
+        {
+            usage();
+            return 2;
+        }
+        else
+            dirs.push_back(argv[i]);
+    }
+    if(dirs.empty())
+    {
+        usage();
+        return 2;
+    }
+
+    FILE *fp = output ? fopen(output, "w") : stdout;
+    if(fp == NULL)
+    {
+        perror("fsct_bench: cannot open output file");
+        return 1;
+    }
+    //每个线程数的结果在运行后立即写出, config中的threads即为该次运行的线程数
+    bool sweep = threadList.size() > 1;
+    int written = 0;
+    if(sweep)
+        fprintf(fp, "[\n");
+    for(size_t t = 0; t < MAX(threadList.size(), (size_t)1); t++)
+    {
+        if(!threadList.empty())
+            setNumThreads(threadList[t]);
+        vector<SeqResult> results;
+        runSequences(dirs, &param, load, profile, targets, allocCheck, results);
+        if(results.empty())
+            continue;
+        //默认参数的运行只用于对比, 不统计阶段耗时也不检查内存分配
+        vector<SeqResult> baseline;
+        if(compare)
+        {
+            TrackParam baseParam;
+            setDefaultParam(&baseParam);
+            runSequences(dirs, &baseParam, load, false, targets, false, baseline);
+        }
+        if(sweep && written > 0)
+            fprintf(fp, ",\n");
+        writeJson(fp, &param, load, allocCheck, results, compare ? &baseline : NULL, perFrame);
+        written++;
+    }
+    if(sweep)
+        fprintf(fp, "]\n");
+    if(fp != stdout)
+        fclose(fp);
+    freeHogLutCache();
+    return written > 0 ? 0 : 1;
+}
@@ -0,0 +1,61 @@
+#-------------------------------------------------
+#
+# 无界面的跟踪性能与精度测试程序, 不依赖Qt与显示设备
+#
+#-------------------------------------------------
+
+QT       -= core gui
+
+TARGET = fsct_bench
+TEMPLATE = app
+CONFIG += console c++11 thread
+CONFIG -= app_bundle qt
+
+CONFIG(debug, debug|release) {
+    DESTDIR =       $$PWD/debug
+    OBJECTS_DIR =   $$PWD/debug/bench_obj
+}
+
+CONFIG(release, debug|release) {
+    DESTDIR =       $$PWD/release
+    OBJECTS_DIR =   $$PWD/release/bench_obj
+}
+
+SOURCES += fsct_bench.cpp \
+        corrtrack.cpp \
+        multitrack.cpp \
+        stagetimer.cpp \
+        alloccount.cpp \
+        framesource.cpp \
+        hog.c \
+        lpt.c \
+        fft.c \
+        resample.c
+
+HEADERS  += corrtrack.h \
+        multitrack.h \
+        stagetimer.h \
+        alloccount.h \
+        framesource.h \
+        hog.h \
+        lpt.h \
+        fft.h \
+        resample.h
+
+win32 {
+INCLUDEPATH += D:\OpenCV3.1.0\build\include
+
+CONFIG(release, debug|release){
+LIBS += -LD:\OpenCV3.1.0\build\x64\vc10\lib \
+    -lopencv_world310
+}
+CONFIG(debug, debug|release){
+LIBS += -LD:\OpenCV3.1.0\build\x64\vc10\lib \
+    -lopencv_world310d
+}
+}
+
+unix {
+CONFIG += link_pkgconfig
+PKGCONFIG += opencv
+}
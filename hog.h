@@ -37,6 +37,11 @@ extern "C" {
 #define MIN_VAL(x,y) (((x)<(y))?(x):(y))
 #define MAX_VAL(x,y) (((x)>(y))?(x):(y))
 
+/* 并行任务: 处理第index个子任务 */
+typedef void (*HogTask)(void *arg, int index);
+/* 调用者提供的线程池接口: 以任意顺序执行task(arg, 0)至task(arg, count-1), 全部完成后返回 */
+typedef void (*HogParallelFor)(void *pool, int count, HogTask task, void *arg);
+
 typedef struct FHOG
 {
     int dimension;          //HOG特征的维数
@@ -46,15 +51,34 @@ typedef struct FHOG
     int histHeight;         //梯度直方图高度(cell纵向个数)
     float *hist;            //有方向梯度直方图buffer
     float *histNorm;        //梯度直方图归一化buffer
+    float *blockNorm;       //各2x2 block的归一化因子, 见calcBlockNorm
     int glyphSize;          //单个cell的可视化HOG特征尺寸
     unsigned char *glyphs;  //HOG特征可视化缓存
     float *gammaLut;        //伽马校正查找表
+    const float *gradLut;   //共享的梯度查找表, 由|dx|, |dy|查得幅值与第一象限内的方向, 见newGradientLut
+    int gradWidth;          //以下逐列表与行缓存对应的图像宽度
+    int *colCell;           //各列像素投票的左右两个cell的横向索引, 交错存放
+    float *colWeight;       //各列像素分配给左右两个cell的权重, 交错存放
+    float *rowGrad;         //一行像素的x, y方向梯度, 计算后原位替换为相邻两个方向的投票值
+    int *rowBin;            //一行像素的梯度方向索引
+    HogParallelFor parallelFor; //并行计算所用的线程池接口, 为NULL时串行计算
+    void *parallelPool;     //传给parallelFor的线程池
+    int nBands;             //并行计算的最大行带数
+    int bandWidth;          //以下行带缓存对应的图像宽度
+    int bandCount;          //以下行带缓存对应的行带数
+    float *bandGrad;        //各行带私有的行梯度缓存
+    int *bandBin;           //各行带私有的方向索引缓存
+    float *bandEdge;        //各行带投到下一行带首行cell的边界直方图
 } FHOG;
 
-FHOG* newHogDescriptor(int cellsize, int numOrientations, int glyph, int gammaCorrection);
+FHOG* newHogDescriptor(int cellsize, int numOrientations, int glyph, int gammaCorrection, int gradientLut);
 
 void freeHogDescriptor(FHOG* self);
 
+void freeHogLutCache(void);
+
+void setHogParallel(FHOG* self, HogParallelFor parallelFor, void *pool, int nBands);
+
 int getHogFeatureSize(const FHOG* self, int width, int height);
 
 int getHogFeatureCols(const FHOG* self, int width);
@@ -70,6 +94,11 @@ int getHogRenderHeight(const FHOG* self, int height);
 
 void calcHogFeature(FHOG* self, const unsigned char *image, int width, int height, float* features);
 
+void calcHogFeatureWindowed(FHOG* self, const unsigned char *image, int width, int height,
+                            const float *window, float* features);
+
+void normalizeHogFeature(FHOG* self, float* features);
+
 int getHogFeatureGlyphSize(const FHOG* self);
 
 void renderHogFeature(const FHOG* self, const float* features, unsigned char* vImg);
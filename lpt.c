@@ -9,6 +9,8 @@ static __inline unsigned char trunc2byte(int value);
 static __inline unsigned char bilinear(const unsigned char *pixel, unsigned int u_8, unsigned int v_8);
 static __inline unsigned char bilinear_rightBorder(const unsigned char *pixel, unsigned int u_8, unsigned int v_8);
 static __inline unsigned char bilinear_bottomBorder(const unsigned char *pixel, unsigned int u_8, unsigned int v_8);
+static __inline int clampCoord(int value, int limit);
+static __inline unsigned char loadGray(const unsigned char *p, int channels);
 
 
 /**
@@ -62,6 +64,10 @@ LPT_Grid *newLptGrid(int imgWidth, int imgHeight, int gridWidth, int gridHeight,
     lpt->rho = gridWidth;
     lpt->theta = gridHeight;
     lpt->rhoMinRate = rhoMinRate;
+    lpt->xScale = 65536;
+    lpt->yScale = 65536;
+    lpt->xOffset = 0;
+    lpt->yOffset = 0;
     lpt->xGrid = (int*)malloc(sizeof(int) * gridWidth * gridHeight);
     lpt->yGrid = (int*)malloc(sizeof(int) * gridWidth * gridHeight);
     assert(lpt->xGrid != NULL && lpt->yGrid != NULL);
@@ -173,6 +179,112 @@ void logPolar(const unsigned char *src, unsigned char *dst, LPT_Grid *lpt)
     return;
 }
 
+/**
+ * @brief 把网格映射到整帧图像中, 使网格的源图像区域对应整帧中中心为(centerX, centerY),
+ * 尺寸为width x height的区域
+ * @param lpt LPT变换所需的插值网格结构
+ * @param centerX 区域中心在整帧中的x坐标
+ * @param centerY 区域中心在整帧中的y坐标
+ * @param width 区域宽度
+ * @param height 区域高度
+ * 网格坐标p到整帧坐标的映射与把该区域缩放到源图像尺寸(cv::resize)后再变换相同:
+ * X = (p + 0.5) * width / imgWidth - 0.5 + left, 即X = p * xScale + xOffset.
+ * 只更新仿射系数, 网格本身不变, 无需重新计算exp, cos与sin.
+ */
+void rebaseLptGrid(LPT_Grid *lpt, float centerX, float centerY, float width, float height)
+{
+    float sx = width / lpt->imgWidth;
+    float sy = height / lpt->imgHeight;
+    float left = centerX - width * 0.5f;
+    float top = centerY - height * 0.5f;
+    assert(width > 0 && height > 0);
+    lpt->xScale = (int)(sx * 65536 + 0.5f);
+    lpt->yScale = (int)(sy * 65536 + 0.5f);
+    lpt->xOffset = (int)floor((left + 0.5f * sx - 0.5f) * 65536 + 0.5f);
+    lpt->yOffset = (int)floor((top + 0.5f * sy - 0.5f) * 65536 + 0.5f);
+    return;
+}
+
+/**
+ * @brief 直接从整帧图像采样的对数极坐标变换
+ * @param src 整帧图像(单通道)
+ * @param width 整帧宽度
+ * @param height 整帧高度
+ * @param stride 整帧相邻两行首地址之间的字节数
+ * @param channels 整帧通道数, 1为灰度图像, 2为YUYV图像(只读取亮度), 3为BGR图像
+ * @param dst 目标图像
+ * @param lpt 已由rebaseLptGrid映射到整帧中的插值网格
+ * 网格坐标经仿射变换得到整帧中的定点坐标, 插值方式与logPolar相同.
+ * 坐标超出整帧时近邻像素截断在图像内, 等价于复制边界像素.
+ * BGR图像先把4个近邻像素转换为灰度再插值.
+ */
+void logPolarFrame(const unsigned char *src, int width, int height, int stride, int channels,
+                   unsigned char *dst, const LPT_Grid *lpt)
+{
+    int j, i;
+    int fx, fy; /* 整帧中的坐标(16.16定点数) */
+    int x, y, x1, y1;
+    unsigned int u_8, v_8;
+    unsigned char *pd;
+    unsigned char pixel[4];
+    assert(channels >= 1 && channels <= 3);
+    for(j = 0; j < lpt->theta; j++)
+    {
+        const int *px = lpt->xGrid + j * lpt->rho;
+        const int *py = lpt->yGrid + j * lpt->rho;
+        pd = dst + j * lpt->rho;
+        for(i = 0; i < lpt->rho; i++)
+        {
+            fx = (int)(((long long)px[i] * lpt->xScale) >> 16) + lpt->xOffset;
+            fy = (int)(((long long)py[i] * lpt->yScale) >> 16) + lpt->yOffset;
+            x = fx >> 16;
+            y = fy >> 16;
+            u_8 = (fx & 0xFFFF) >> 8;
+            v_8 = (fy & 0xFFFF) >> 8;
+            if(x >= 0 && y >= 0 && x < width - 1 && y < height - 1) /* 未越界 */
+            {
+                const unsigned char *ps = src + y * stride + x * channels;
+                pixel[0] = loadGray(ps, channels);
+                pixel[1] = loadGray(ps + stride, channels);
+                pixel[2] = loadGray(ps + channels, channels);
+                pixel[3] = loadGray(ps + stride + channels, channels);
+            }
+            else /* 越界, 复制边界像素 */
+            {
+                x1 = clampCoord(x + 1, width);
+                y1 = clampCoord(y + 1, height);
+                x = clampCoord(x, width);
+                y = clampCoord(y, height);
+                pixel[0] = loadGray(src + y * stride + x * channels, channels);
+                pixel[1] = loadGray(src + y1 * stride + x * channels, channels);
+                pixel[2] = loadGray(src + y * stride + x1 * channels, channels);
+                pixel[3] = loadGray(src + y1 * stride + x1 * channels, channels);
+            }
+            pd[i] = bilinear(pixel, u_8, v_8);
+        }
+    }
+    return;
+}
+
+/**
+ * @brief 把坐标截断在[0, limit-1]之间
+ */
+static __inline int clampCoord(int value, int limit)
+{
+    return value < 0 ? 0 : (value >= limit ? limit - 1 : value);
+}
+
+/**
+ * @brief 读取一个像素的灰度值, BGR像素按cv::cvtColor的定点系数转换,
+ * 灰度与YUYV像素直接取首字节(亮度)
+ */
+static __inline unsigned char loadGray(const unsigned char *p, int channels)
+{
+    if(channels != 3)
+        return p[0];
+    return (unsigned char)((p[0] * 1868 + p[1] * 9617 + p[2] * 4899 + 8192) >> 14);
+}
+
 /**
  * @brief 把整形数据截断在[0, 255]之间成为unsigned char型
  * @param Value: 输入int型数据
@@ -10,6 +10,11 @@
  * 此外, 该源码实现的对数极坐标变换引入的"最小极径系数"的概念, 避
  * 免在变换中心产生大面积渐变模式的图像, 使变换后的图像包含更多的
  * 有效信息. 最小极径系数的原理请参见作者的相关论文.
+ * 跟踪中源图像是整帧中以目标为中心截取并缩放的图像块. 为省去截取与缩放,
+ * 可用rebaseLptGrid把网格仿射映射到整帧坐标系中目标所在的位置与尺度,
+ * 再由logPolarFrame直接从整帧采样, 超出整帧的部分复制边界像素. 网格坐标
+ * 仍只在新建时计算一次, 每帧的调整只是对定点坐标的缩放与平移. 整帧可以是
+ * BGR彩色图像, 只对采样到的像素做灰度转换; 也可以是YUYV图像, 只读取亮度.
  *
  * 参考文献:
  * [1] 马晓楠, 刘晓利, 李银伢. 自适应尺度的快速相关滤波跟踪算法[J].
@@ -39,6 +44,10 @@ typedef struct LPT_Grid
     float rhoMinRate;
     int *xGrid;
     int *yGrid;
+    int xScale;     //网格到整帧坐标的仿射变换, 16.16定点数, 见rebaseLptGrid
+    int yScale;
+    int xOffset;
+    int yOffset;
 } LPT_Grid;
 
 LPT_Grid* newLptGrid(int imgWidth, int imgHeight, int gridWidth, int gridHeight, float rhoMinRate);
@@ -47,6 +56,11 @@ void freeLptGrid(LPT_Grid *lpt);
 
 void logPolar(const unsigned char *src, unsigned char *dst, LPT_Grid *lpt);
 
+void rebaseLptGrid(LPT_Grid *lpt, float centerX, float centerY, float width, float height);
+
+void logPolarFrame(const unsigned char *src, int width, int height, int stride, int channels,
+                   unsigned char *dst, const LPT_Grid *lpt);
+
 #ifdef __cplusplus
 }
 #endif //__cplusplus
@@ -0,0 +1,404 @@
+/*
+ * microbench: hog.c, lpt.c与相关滤波核心运算的单项性能测试.
+ * 每一项运算都在固定尺寸的合成数据上反复执行, 先标定迭代次数使单次测量
+ * 不短于设定时间, 再重复测量取中位数, 输出每次运算的耗时(ns/op)与访存量
+ * (bytes/op, 按输入与输出数据量估算). 模板尺寸(特征图边长)可扫描多个取值,
+ * cell尺寸固定为4, 即模板尺寸32对应128x128的图像块.
+ * OpenCV线程数在测试期间固定, 可指定多个取值依次测试.
+ *
+ * 用法: microbench [--sizes 16,32,64] [--threads 1,4] [--half] [--pin]
+ *                  [--time 0.2] [--csv] [--alloc-check]
+ *   --sizes    模板尺寸列表, 须为2的整数次幂
+ *   --threads  OpenCV线程数列表
+ *   --half     频域运算使用半频谱
+ *   --pin      (Linux)将进程绑定在前N个CPU上, N为当前线程数
+ *   --time     每次测量的最短时间(秒)
+ *   --csv      以CSV格式输出
+ *   --alloc-check  统计预热后每次运算新分配的Mat缓存数(allocs/op), 稳定状态下应为0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+#include "corrtrack.h"
+#include "alloccount.h"
+#include "hog.h"
+#include "lpt.h"
+#include "fft.h"
+
+using namespace std;
+using namespace cv;
+
+#define BENCH_CELL_SIZE 4
+#define BENCH_REPEATS 5
+
+/*
+ * 通过继承访问CorrTrack中受保护的频域运算, 所有数据在构造时准备好,
+ * 各测试项只执行对应的一次运算
+ */
+class KernelBench : public CorrTrack
+{
+public:
+    typedef void (KernelBench::*Op)();
+
+    KernelBench(int pattSz, bool halfSpectrum);
+    virtual ~KernelBench();
+
+    void opCalcHog();
+    void opCalcHogLut();
+    void opCalcHogParallel();
+    void opNormalizeHist();
+    void opLogPolar();
+    void opLogPolarFrame();
+    void opNewLptGrid();
+    void opFft2();
+    void opGaussKernel();
+    void opTrain();
+    void opDetect();
+    void opSubPixelPeak();
+
+    double getBytes(Op op) const;
+
+private:
+    int pattSz;
+    int patchSz;
+    int channels;
+    int specCols;
+    float sigma;
+    float lambda;
+    FHOG *hog;
+    FHOG *hogLut;
+    FHOG *hogParallel;
+    LPT_Grid *lpt;
+    CorrWorkspace ws;
+    Mat patch;
+    Mat frame;
+    Mat lptDst;
+    Mat hannWin;
+    Mat gaussLabelF;
+    Mat feat;
+    Mat featF;
+    Mat modelF;
+    Mat alphaF;
+    Point maxLoc;
+    Point2f pos;
+};
+
+KernelBench::KernelBench(int pattSz, bool halfSpectrum)
+{
+    this->pattSz = pattSz;
+    patchSz = pattSz * BENCH_CELL_SIZE;
+    sigma = 0.5;
+    lambda = 0.0001;
+    useHalfSpectrum = halfSpectrum;
+
+    //合成纹理: 均匀噪声经高斯平滑, 梯度方向分布接近自然图像
+    patch.create(patchSz, patchSz, CV_8U);
+    randu(patch, 0, 256);
+    GaussianBlur(patch, patch, Size(5, 5), 1.5);
+    frame.create(480, 640, CV_8U);
+    randu(frame, 0, 256);
+    GaussianBlur(frame, frame, Size(5, 5), 1.5);
+    lptDst.create(patchSz, patchSz, CV_8U);
+    hog = newHogDescriptor(BENCH_CELL_SIZE, 9, 0, 0, 0);
+    hogLut = newHogDescriptor(BENCH_CELL_SIZE, 9, 0, 0, 1);
+    hogParallel = newHogDescriptor(BENCH_CELL_SIZE, 9, 0, 0, 0);
+    setHogParallel(hogParallel, cvHogParallelFor, NULL, getNumThreads());
+    lpt = newLptGrid(patchSz, patchSz, patchSz, patchSz, 0.2f);
+    channels = getHogFeatureChannels(hog);
+    ws.fft = newFftPlan(pattSz, pattSz);
+    specCols = halfSpectrum ? getFftHalfWidth(ws.fft) : pattSz;
+    initWorkspace(&ws, pattSz, channels);
+
+    Size patSz(pattSz, pattSz);
+    getHannWindow(hannWin, patSz);
+    getGaussLabelF(gaussLabelF, patSz, pattSz / 24.0f);
+    getFeatures(patch, feat, hannWin, hog);
+    fft2(feat, featF, ws.fft);
+    featF.copyTo(modelF);
+    train(modelF, gaussLabelF, alphaF, sigma, lambda, &ws);
+    detect(featF, modelF, alphaF, pos, sigma, &ws);
+    maxLoc = Point(pattSz / 2, pattSz / 2);
+}
+
+KernelBench::~KernelBench()
+{
+    freeHogDescriptor(hog);
+    freeHogDescriptor(hogLut);
+    freeHogDescriptor(hogParallel);
+    freeLptGrid(lpt);
+    freeFftPlan(ws.fft);
+    ws.fft = NULL;
+}
+
+void KernelBench::opCalcHog()
+{
+    calcHogFeature(hog, patch.data, patchSz, patchSz, feat.ptr<float>(0, 0, 0));
+}
+
+void KernelBench::opCalcHogLut()
+{
+    calcHogFeature(hogLut, patch.data, patchSz, patchSz, feat.ptr<float>(0, 0, 0));
+}
+
+void KernelBench::opCalcHogParallel()
+{
+    calcHogFeature(hogParallel, patch.data, patchSz, patchSz, feat.ptr<float>(0, 0, 0));
+}
+
+void KernelBench::opNormalizeHist()
+{
+    normalizeHogFeature(hog, feat.ptr<float>(0, 0, 0));
+}
+
+void KernelBench::opLogPolar()
+{
+    logPolar(patch.data, lptDst.data, lpt);
+}
+
+void KernelBench::opLogPolarFrame()
+{
+    //目标区域为归一化尺寸的2倍, 位于整帧中心
+    rebaseLptGrid(lpt, frame.cols * 0.5f, frame.rows * 0.5f, patchSz * 2.0f, patchSz * 2.0f);
+    logPolarFrame(frame.data, frame.cols, frame.rows, (int)frame.step[0], 1, lptDst.data, lpt);
+}
+
+void KernelBench::opNewLptGrid()
+{
+    freeLptGrid(newLptGrid(patchSz, patchSz, patchSz, patchSz, 0.2f));
+}
+
+void KernelBench::opFft2()
+{
+    fft2(feat, featF, ws.fft);
+}
+
+void KernelBench::opGaussKernel()
+{
+    gaussCorrelationKernel(featF, modelF, sigma, false, &ws);
+}
+
+void KernelBench::opTrain()
+{
+    train(featF, gaussLabelF, ws.alphaF, sigma, lambda, &ws);
+}
+
+void KernelBench::opDetect()
+{
+    detect(featF, modelF, alphaF, pos, sigma, &ws);
+}
+
+void KernelBench::opSubPixelPeak()
+{
+    getSubPixelPeak(maxLoc, ws.response, pos);
+}
+
+/**
+ * @brief 估算一次运算读写的数据量(字节), 只计输入与输出, 不计中间缓存的重复访问
+ */
+double KernelBench::getBytes(Op op) const
+{
+    double pixels = (double)patchSz * patchSz;
+    double cells = (double)pattSz * pattSz;
+    double spec = (double)pattSz * specCols * 8;    //单通道复数频谱
+    double real = cells * 4;                        //单通道实数矩阵
+    double kernel = 2 * channels * spec + 3 * spec + 2 * real;
+    if(op == &KernelBench::opCalcHog || op == &KernelBench::opCalcHogLut || op == &KernelBench::opCalcHogParallel)
+        return pixels + cells * 18 * 4 + cells * 4 + channels * real;
+    if(op == &KernelBench::opNormalizeHist)
+        return cells * 18 * 4 + cells * 4 + channels * real;
+    if(op == &KernelBench::opLogPolar)
+        return pixels * 4 + pixels * 8 + pixels;
+    if(op == &KernelBench::opLogPolarFrame)
+        return pixels * 8 + pixels * 4 + pixels;
+    if(op == &KernelBench::opNewLptGrid)
+        return pixels * 8;
+    if(op == &KernelBench::opFft2)
+        return channels * (real + spec);
+    if(op == &KernelBench::opGaussKernel)
+        return kernel;
+    if(op == &KernelBench::opTrain)
+        return kernel + 2 * spec;
+    if(op == &KernelBench::opDetect)
+        return kernel + 3 * spec + real;
+    if(op == &KernelBench::opSubPixelPeak)
+        return 9 * 4;
+    return 0;
+}
+
+typedef struct BenchItem
+{
+    const char *name;
+    KernelBench::Op op;
+} BenchItem;
+
+static const BenchItem BENCH_ITEMS[] = {
+    {"calcHogFeature", &KernelBench::opCalcHog},
+    {"calcHogFeatureLut", &KernelBench::opCalcHogLut},
+    {"calcHogFeatureParallel", &KernelBench::opCalcHogParallel},
+    {"normalizeHist", &KernelBench::opNormalizeHist},
+    {"logPolar", &KernelBench::opLogPolar},
+    {"logPolarFrame", &KernelBench::opLogPolarFrame},
+    {"newLptGrid", &KernelBench::opNewLptGrid},
+    {"fft2", &KernelBench::opFft2},
+    {"gaussCorrelationKernel", &KernelBench::opGaussKernel},
+    {"train", &KernelBench::opTrain},
+    {"detect", &KernelBench::opDetect},
+    {"getSubPixelPeak", &KernelBench::opSubPixelPeak}
+};
+
+/**
+ * @brief 测量一项运算的耗时: 迭代次数翻倍直至单次测量不短于minSeconds,
+ * 再以该迭代次数重复测量BENCH_REPEATS次, 取中位数
+ * @param allocs 输出重复测量期间平均每次运算新分配的Mat缓存数, 安装了计数分配器时有效
+ * @return ns/op
+ */
+static double measure(KernelBench &bench, KernelBench::Op op, double minSeconds, double *allocs)
+{
+    double tickToNs = 1e9 / getTickFrequency();
+    long iters = 1;
+    for(int i = 0; i < 3; i++)
+        (bench.*op)(); //预热
+    while(1)
+    {
+        int64 t = getTickCount();
+        for(long i = 0; i < iters; i++)
+            (bench.*op)();
+        double ns = (getTickCount() - t) * tickToNs;
+        if(ns >= minSeconds * 1e9 || iters >= (1L << 30))
+            break;
+        iters *= 2;
+    }
+    vector<double> samples;
+    int allocStart = getAllocCount();
+    for(int r = 0; r < BENCH_REPEATS; r++)
+    {
+        int64 t = getTickCount();
+        for(long i = 0; i < iters; i++)
+            (bench.*op)();
+        samples.push_back((getTickCount() - t) * tickToNs / iters);
+    }
+    *allocs = (double)(getAllocCount() - allocStart) / ((double)iters * BENCH_REPEATS);
+    sort(samples.begin(), samples.end());
+    return samples[BENCH_REPEATS / 2];
+}
+
+static void parseList(const char *arg, vector<int> &list)
+{
+    list.clear();
+    const char *p = arg;
+    while(*p)
+    {
+        list.push_back(atoi(p));
+        while(*p && *p != ',')
+            p++;
+        if(*p == ',')
+            p++;
+    }
+}
+
+static void pinCpus(int n)
+{
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for(int i = 0; i < n && i < CPU_SETSIZE; i++)
+        CPU_SET(i, &set);
+    if(sched_setaffinity(0, sizeof(set), &set) != 0)
+        perror("microbench: sched_setaffinity");
+#else
+    (void)n;
+    fprintf(stderr, "microbench: --pin is only supported on Linux\n");
+#endif
+}
+
+static void usage()
+{
+    fprintf(stderr, "usage: microbench [--sizes 16,32,64] [--threads 1,4] [--half] [--pin]\n"
+                    "                  [--time 0.2] [--csv] [--alloc-check]\n");
+}
+
+int main(int argc, char *argv[])
+{
+    vector<int> sizes, threads;
+    bool half = false, pin = false, csv = false, allocCheck = false;
+    double minSeconds = 0.2;
+    parseList("16,32,64", sizes);
+    parseList("1", threads);
+    for(int i = 1; i < argc; i++)
+    {
+        if(!strcmp(argv[i], "--sizes") && i + 1 < argc)
+            parseList(argv[++i], sizes);
+        else if(!strcmp(argv[i], "--threads") && i + 1 < argc)
+            parseList(argv[++i], threads);
+        else if(!strcmp(argv[i], "--time") && i + 1 < argc)
+            minSeconds = atof(argv[++i]);
+        else if(!strcmp(argv[i], "--half"))
+            half = true;
+        else if(!strcmp(argv[i], "--pin"))
+            pin = true;
+        else if(!strcmp(argv[i], "--csv"))
+            csv = true;
+        else if(!strcmp(argv[i], "--alloc-check"))
+            allocCheck = true;
+        else
+        {
+            usage();
+            return 2;
+        }
+    }
+    for(size_t i = 0; i < sizes.size(); i++)
+    {
+        if(sizes[i] < 4 || !isPower2((unsigned int)sizes[i]))
+        {
+            fprintf(stderr, "microbench: pattern size %d is not a power of 2\n", sizes[i]);
+            return 2;
+        }
+    }
+
+    if(allocCheck)
+        installAllocCounter();
+    if(csv)
+        printf("kernel,pattern,patch,threads,spectrum,ns_per_op,bytes_per_op,gb_per_s%s\n", allocCheck ? ",allocs_per_op" : "");
+    else
+        printf("%-24s %7s %6s %7s %4s %14s %14s %9s%s\n",
+               "kernel", "pattern", "patch", "threads", "spec", "ns/op", "bytes/op", "GB/s", allocCheck ? "  allocs/op" : "");
+    for(size_t t = 0; t < threads.size(); t++)
+    {
+        int nThreads = MAX(threads[t], 1);
+        setNumThreads(nThreads);
+        if(pin)
+            pinCpus(nThreads);
+        for(size_t s = 0; s < sizes.size(); s++)
+        {
+            KernelBench bench(sizes[s], half);
+            for(size_t k = 0; k < sizeof(BENCH_ITEMS) / sizeof(BENCH_ITEMS[0]); k++)
+            {
+                double allocs = 0;
+                double ns = measure(bench, BENCH_ITEMS[k].op, minSeconds, &allocs);
+                double bytes = bench.getBytes(BENCH_ITEMS[k].op);
+                int patch = sizes[s] * BENCH_CELL_SIZE;
+                if(csv)
+                    printf("%s,%d,%d,%d,%s,%.1f,%.0f,%.3f", BENCH_ITEMS[k].name, sizes[s], patch,
+                           nThreads, half ? "half" : "full", ns, bytes, bytes / ns);
+                else
+                    printf("%-24s %7d %6d %7d %4s %14.1f %14.0f %9.3f", BENCH_ITEMS[k].name, sizes[s],
+                           patch, nThreads, half ? "half" : "full", ns, bytes, bytes / ns);
+                if(allocCheck)
+                    printf(csv ? ",%.3f" : " %10.3f", allocs);
+                printf("\n");
+                fflush(stdout);
+            }
+        }
+    }
+    freeHogLutCache();
+    return 0;
+}
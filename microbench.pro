@@ -0,0 +1,59 @@
+#-------------------------------------------------
+#
+# hog.c, lpt.c与相关滤波核心运算的单项性能测试, 不依赖Qt与显示设备
+#
+#-------------------------------------------------
+
+QT       -= core gui
+
+TARGET = microbench
+TEMPLATE = app
+CONFIG += console c++11 thread
+CONFIG -= app_bundle qt
+
+CONFIG(debug, debug|release) {
+    DESTDIR =       $$PWD/debug
+    OBJECTS_DIR =   $$PWD/debug/microbench_obj
+}
+
+CONFIG(release, debug|release) {
+    DESTDIR =       $$PWD/release
+    OBJECTS_DIR =   $$PWD/release/microbench_obj
+}
+
+SOURCES += microbench.cpp \
+        corrtrack.cpp \
+        stagetimer.cpp \
+        alloccount.cpp \
+        framesource.cpp \
+        hog.c \
+        lpt.c \
+        fft.c \
+        resample.c
+
+HEADERS  += corrtrack.h \
+        stagetimer.h \
+        alloccount.h \
+        framesource.h \
+        hog.h \
+        lpt.h \
+        fft.h \
+        resample.h
+
+win32 {
+INCLUDEPATH += D:\OpenCV3.1.0\build\include
+
+CONFIG(release, debug|release){
+LIBS += -LD:\OpenCV3.1.0\build\x64\vc10\lib \
+    -lopencv_world310
+}
+CONFIG(debug, debug|release){
+LIBS += -LD:\OpenCV3.1.0\build\x64\vc10\lib \
+    -lopencv_world310d
+}
+}
+
+unix {
+CONFIG += link_pkgconfig
+PKGCONFIG += opencv
+}
@@ -0,0 +1,221 @@
+#include <vector>
+#include <opencv2/core.hpp>
+
+#include "multitrack.h"
+
+using namespace std;
+using namespace cv;
+
+/**
+ * @brief 多目标并行初始化任务, 每个stripe负责一个目标
+ */
+class MultiInitBody : public ParallelLoopBody
+{
+public:
+    MultiInitBody(CorrTrack **trackers, Rect *rects, Mat *frame)
+        : trackers(trackers), rects(rects), frame(frame) {}
+    virtual void operator()(const Range &range) const
+    {
+        for(int i = range.start; i < range.end; i++)
+            trackers[i]->initTarget(*frame, rects[i]);
+    }
+private:
+    CorrTrack **trackers;
+    Rect *rects;
+    Mat *frame;
+};
+
+/**
+ * @brief 多目标并行跟踪任务, 每个stripe负责一个目标, 并记录该目标的单帧耗时
+ */
+class MultiTrackBody : public ParallelLoopBody
+{
+public:
+    MultiTrackBody(CorrTrack **trackers, Rect *rects, TrackLatency *latency, Mat *frame)
+        : trackers(trackers), rects(rects), latency(latency), frame(frame) {}
+    virtual void operator()(const Range &range) const
+    {
+        double tickToMs = 1000.0 / getTickFrequency();
+        for(int i = range.start; i < range.end; i++)
+        {
+            int64 t = getTickCount();
+            trackers[i]->trackEachFrame(*frame, rects[i]);
+            double ms = (getTickCount() - t) * tickToMs;
+            latency[i].last = ms;
+            latency[i].total += ms;
+            latency[i].max = MAX_VAL(latency[i].max, ms);
+            latency[i].count++;
+        }
+    }
+private:
+    CorrTrack **trackers;
+    Rect *rects;
+    TrackLatency *latency;
+    Mat *frame;
+};
+
+MultiTracker::MultiTracker(TrackParam *param)
+{
+    initParam(param);
+    frameLatency = 0;
+    totalLatency = 0;
+    targetFrames = 0;
+    frameCount = 0;
+    allocCheck = false;
+}
+
+MultiTracker::~MultiTracker()
+{
+    clearTargets();
+}
+
+/**
+ * @brief 设置之后新加入目标所使用的跟踪参数, 已有目标不受影响
+ * @param param 跟踪参数
+ */
+void MultiTracker::initParam(TrackParam *param)
+{
+    this->param = *param;
+}
+
+/**
+ * @brief 在当前帧上新增一个跟踪目标
+ * @param frameBuf 当前帧(BGR或灰度)
+ * @param tgtRect 目标区域
+ * @return 新目标的索引号
+ */
+int MultiTracker::addTarget(Mat &frameBuf, Rect &tgtRect)
+{
+    CorrTrack *fsct = new CorrTrack(&param);
+    TrackLatency lat = {0, 0, 0, 0};
+    fsct->initTarget(frameBuf, tgtRect);
+    trackers.push_back(fsct);
+    targetRects.push_back(tgtRect);
+    latency.push_back(lat);
+    if(allocCheck)
+        setAllocCheck(true);
+    return (int)trackers.size() - 1;
+}
+
+/**
+ * @brief 在当前帧上一次性新增多个跟踪目标, 各目标的初始化并行执行
+ * @param frameBuf 当前帧(BGR或灰度)
+ * @param tgtRects 目标区域列表
+ */
+void MultiTracker::addTargets(Mat &frameBuf, vector<Rect> &tgtRects)
+{
+    int start = (int)trackers.size();
+    int n = (int)tgtRects.size();
+    TrackLatency lat = {0, 0, 0, 0};
+    if(n == 0)
+        return;
+    for(int i = 0; i < n; i++)
+    {
+        trackers.push_back(new CorrTrack(&param));
+        targetRects.push_back(tgtRects[i]);
+        latency.push_back(lat);
+    }
+    MultiInitBody body(&trackers[start], &targetRects[start], &frameBuf);
+    parallel_for_(Range(0, n), body, n);
+    if(allocCheck)
+        setAllocCheck(true);
+}
+
+void MultiTracker::removeTarget(int idx)
+{
+    assert(idx >= 0 && idx < (int)trackers.size());
+    delete trackers[idx];
+    trackers.erase(trackers.begin() + idx);
+    targetRects.erase(targetRects.begin() + idx);
+    latency.erase(latency.begin() + idx);
+}
+
+void MultiTracker::clearTargets()
+{
+    for(size_t i = 0; i < trackers.size(); i++)
+        delete trackers[i];
+    trackers.clear();
+    targetRects.clear();
+    latency.clear();
+}
+
+/**
+ * @brief 跟踪所有目标, 各目标在线程池中并行采样, 检测与训练
+ * @param frameBuf 当前帧(BGR或灰度)
+ * @param outRects 各目标的跟踪结果, 与目标索引一一对应
+ */
+void MultiTracker::trackEachFrame(Mat &frameBuf, vector<Rect> &outRects)
+{
+    int n = (int)trackers.size();
+    if(frameBuf.empty())
+        return;
+    int64 t = getTickCount();
+    if(n > 0)
+    {
+        MultiTrackBody body(&trackers[0], &targetRects[0], &latency[0], &frameBuf);
+        parallel_for_(Range(0, n), body, n);
+    }
+    frameLatency = (getTickCount() - t) * 1000.0 / getTickFrequency();
+    totalLatency += frameLatency;
+    targetFrames += n;
+    frameCount++;
+    outRects = targetRects;
+}
+
+int MultiTracker::getTargetCount() const
+{
+    return (int)trackers.size();
+}
+
+/**
+ * @brief 获取单个目标的耗时统计(ms)
+ * @param idx 目标索引
+ * @return
+ */
+const TrackLatency& MultiTracker::getTargetLatency(int idx) const
+{
+    assert(idx >= 0 && idx < (int)latency.size());
+    return latency[idx];
+}
+
+/**
+ * @brief 获取最近一帧处理全部目标的总耗时(ms)
+ * @return
+ */
+double MultiTracker::getFrameLatency() const
+{
+    return frameLatency;
+}
+
+/**
+ * @brief 获取平均吞吐量, 即每秒跟踪的目标帧数(目标数 x 帧数 / 秒)
+ * @return
+ */
+double MultiTracker::getThroughput() const
+{
+    if(totalLatency <= 0)
+        return 0;
+    return targetFrames * 1000.0 / totalLatency;
+}
+
+/**
+ * @brief 设置并行跟踪所使用的线程数, 该设置作用于OpenCV的全局线程池
+ * @param nThreads 线程数, 小于等于0时恢复OpenCV默认值
+ */
+void MultiTracker::setNumThreads(int nThreads)
+{
+    cv::setNumThreads(nThreads <= 0 ? -1 : nThreads);
+}
+
+/**
+ * @brief 开启或关闭所有目标的工作空间检查, 见CorrTrack::setAllocCheck.
+ * 各目标并行跟踪, 分配计数是全局的, 新目标第一帧的分配会计入其他目标,
+ * 因此新增目标后所有目标都重新以下一帧为基准
+ * @param enable
+ */
+void MultiTracker::setAllocCheck(bool enable)
+{
+    allocCheck = enable;
+    for(size_t i = 0; i < trackers.size(); i++)
+        trackers[i]->setAllocCheck(enable);
+}
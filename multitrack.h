@@ -0,0 +1,55 @@
+#ifndef MULTITRACK_H
+#define MULTITRACK_H
+
+#include <vector>
+#include <opencv2/core.hpp>
+
+#include "corrtrack.h"
+
+typedef struct TrackLatency
+{
+    double last;    //最近一帧的耗时(ms)
+    double total;   //累计耗时(ms)
+    double max;     //最大单帧耗时(ms)
+    int count;      //已跟踪的帧数
+} TrackLatency;
+
+/*
+ * MultiTracker管理多个CorrTrack实例, 每个实例对应一个独立的目标.
+ * 彩色帧不做整帧灰度转换, 各目标只转换自身采样到的像素. 各目标的检测
+ * 与训练过程通过OpenCV的线程池(cv::parallel_for_)并行执行, 每个目标作为
+ * 一个独立的任务, 目标之间不共享任何可写状态.
+ */
+class MultiTracker
+{
+private:
+    TrackParam param;
+    std::vector<CorrTrack*> trackers;
+    std::vector<cv::Rect> targetRects;
+    std::vector<TrackLatency> latency;
+    double frameLatency;
+    double totalLatency;
+    double targetFrames;    //累计跟踪的目标帧数, 不随目标的移除而减少
+    int frameCount;
+    bool allocCheck;
+
+public:
+    MultiTracker(TrackParam *param);
+
+    virtual ~MultiTracker();
+    virtual void initParam(TrackParam *param);
+    virtual int addTarget(cv::Mat &frameBuf, cv::Rect &tgtRect);
+    virtual void addTargets(cv::Mat &frameBuf, std::vector<cv::Rect> &tgtRects);
+    virtual void removeTarget(int idx);
+    virtual void clearTargets();
+    virtual void trackEachFrame(cv::Mat &frameBuf, std::vector<cv::Rect> &outRects);
+
+    virtual int getTargetCount() const;
+    virtual const TrackLatency& getTargetLatency(int idx) const;
+    virtual double getFrameLatency() const;
+    virtual double getThroughput() const;
+    virtual void setNumThreads(int nThreads);
+    virtual void setAllocCheck(bool enable);
+};
+
+#endif // MULTITRACK_H
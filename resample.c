@@ -0,0 +1,301 @@
+#include <stdlib.h>
+#include <math.h>
+#include <assert.h>
+#include "resample.h"
+
+#define RS_MAX_TAPS 256         //区域插值时单个输出像素在一个方向上覆盖的最大像素数
+
+#define RS_MIN(x, y) (((x) < (y)) ? (x) : (y))
+#define RS_MAX(x, y) (((x) > (y)) ? (x) : (y))
+
+//BGR转灰度的定点系数(14位), 与cv::cvtColor一致
+#define RS_GRAY_B 1868
+#define RS_GRAY_G 9617
+#define RS_GRAY_R 4899
+#define RS_GRAY_SHIFT 14
+
+static __inline int getPixelSize(int format);
+static __inline int loadGray(const unsigned char *p, int format);
+static void getLinearTap(int d, double scale, int len, int origin, int limit, int *p0, int *p1, int *alpha);
+static int getAreaTaps(int d, double scale, int len, int origin, int limit, int *pos, float *weight);
+static __inline int addAreaTap(int *pos, float *weight, int n, int p, float w);
+static void resampleBilinear(const RS_Image *src, int x, int y, int width, int height,
+                             unsigned char *dst, int dstWidth, int dstHeight, int dstStride);
+static void resampleArea(const RS_Image *src, int x, int y, int width, int height,
+                         unsigned char *dst, int dstWidth, int dstHeight, int dstStride, RS_Scratch *scratch);
+
+/**
+ * @brief 从源图像中截取(x, y, width, height)区域并缩放到dstWidth x dstHeight,
+ * 区域超出源图像的部分按边界复制处理, 整个过程不产生中间图像
+ * @param src 源图像
+ * @param x 区域左上角x坐标, 可以为负
+ * @param y 区域左上角y坐标, 可以为负
+ * @param width 区域宽度
+ * @param height 区域高度
+ * @param dst 输出图像块
+ * @param dstWidth 输出宽度
+ * @param dstHeight 输出高度
+ * @param dstStride 输出图像相邻两行首地址之间的字节数
+ * @param method 插值方式, RS_BILINEAR或RS_AREA
+ * @param scratch 区域插值所用的缓存, 容量不足时在此扩充, 见reserveResampleScratch.
+ * 只用双线性插值时可为NULL
+ * 结果等价于先以BORDER_REPLICATE截取区域, 再以cv::resize缩放.
+ */
+void resamplePatch(const RS_Image *src, int x, int y, int width, int height,
+                   unsigned char *dst, int dstWidth, int dstHeight, int dstStride, int method,
+                   RS_Scratch *scratch)
+{
+    assert(src != NULL && src->data != NULL && dst != NULL);
+    assert(src->format == RS_FORMAT_GRAY || src->format == RS_FORMAT_BGR || src->format == RS_FORMAT_YUYV);
+    assert(width >= 1 && height >= 1);
+    assert(dstWidth >= 1 && dstHeight >= 1 && dstWidth <= RS_MAX_SIZE && dstHeight <= RS_MAX_SIZE);
+    if(method == RS_AREA && width >= dstWidth && height >= dstHeight)
+    {
+        assert(scratch != NULL);
+        reserveResampleScratch(scratch, src->width, dstWidth);
+        resampleArea(src, x, y, width, height, dst, dstWidth, dstHeight, dstStride, scratch);
+    }
+    else
+        resampleBilinear(src, x, y, width, height, dst, dstWidth, dstHeight, dstStride);
+    return;
+}
+
+/**
+ * @brief 保证缓存足够对宽度为srcWidth的源图像做输出宽度为dstWidth的区域插值.
+ * 容量只与源图像宽度有关, 与采样区域的大小无关, 因此在源图像尺寸确定后调用
+ * 一次, 之后的采样不再分配内存
+ * @param scratch 缓存, 首次使用前须全部置0
+ * @param srcWidth 源图像宽度
+ * @param dstWidth 输出宽度
+ */
+void reserveResampleScratch(RS_Scratch *scratch, int srcWidth, int dstWidth)
+{
+    int capacity = srcWidth + dstWidth; //见resampleArea
+    assert(scratch != NULL);
+    if(scratch->capacity >= capacity)
+        return;
+    freeResampleScratch(scratch);
+    scratch->pos = (int*)malloc(sizeof(int) * capacity);
+    scratch->weight = (float*)malloc(sizeof(float) * capacity);
+    assert(scratch->pos != NULL && scratch->weight != NULL);
+    scratch->capacity = capacity;
+    return;
+}
+
+/**
+ * @brief 释放缓存, 之后可以重新使用
+ */
+void freeResampleScratch(RS_Scratch *scratch)
+{
+    free(scratch->pos);
+    free(scratch->weight);
+    scratch->pos = NULL;
+    scratch->weight = NULL;
+    scratch->capacity = 0;
+    return;
+}
+
+/**
+ * @brief 双线性插值: 每个输出像素由源图像中相邻的2x2个像素插值得到.
+ * 列方向的坐标与权重对所有行都相同, 预先计算一次.
+ * BGR图像先把4个近邻像素转换为灰度再插值, 结果与先转换整帧再插值相同
+ */
+static void resampleBilinear(const RS_Image *src, int x, int y, int width, int height,
+                             unsigned char *dst, int dstWidth, int dstHeight, int dstStride)
+{
+    int x0[RS_MAX_SIZE], x1[RS_MAX_SIZE], ax[RS_MAX_SIZE];
+    double scaleX = (double)width / dstWidth;
+    double scaleY = (double)height / dstHeight;
+    int pixelSize = getPixelSize(src->format);
+    int i, j;
+    for(i = 0; i < dstWidth; i++)
+    {
+        getLinearTap(i, scaleX, width, x, src->width, &x0[i], &x1[i], &ax[i]);
+        x0[i] *= pixelSize;
+        x1[i] *= pixelSize;
+    }
+    for(j = 0; j < dstHeight; j++)
+    {
+        int y0, y1, ay;
+        const unsigned char *r0, *r1;
+        unsigned char *pd = dst + j * dstStride;
+        getLinearTap(j, scaleY, height, y, src->height, &y0, &y1, &ay);
+        r0 = src->data + y0 * src->stride;
+        r1 = src->data + y1 * src->stride;
+        if(src->format != RS_FORMAT_BGR) //灰度与YUYV的亮度都是每个像素的首字节
+        {
+            for(i = 0; i < dstWidth; i++)
+            {
+                int h0 = r0[x0[i]] * (RS_COEF_SCALE - ax[i]) + r0[x1[i]] * ax[i];
+                int h1 = r1[x0[i]] * (RS_COEF_SCALE - ax[i]) + r1[x1[i]] * ax[i];
+                pd[i] = (unsigned char)((h0 * (RS_COEF_SCALE - ay) + h1 * ay
+                                         + (1 << (RS_COEF_BITS * 2 - 1))) >> (RS_COEF_BITS * 2));
+            }
+        }
+        else
+        {
+            for(i = 0; i < dstWidth; i++)
+            {
+                int h0 = loadGray(r0 + x0[i], RS_FORMAT_BGR) * (RS_COEF_SCALE - ax[i])
+                       + loadGray(r0 + x1[i], RS_FORMAT_BGR) * ax[i];
+                int h1 = loadGray(r1 + x0[i], RS_FORMAT_BGR) * (RS_COEF_SCALE - ax[i])
+                       + loadGray(r1 + x1[i], RS_FORMAT_BGR) * ax[i];
+                pd[i] = (unsigned char)((h0 * (RS_COEF_SCALE - ay) + h1 * ay
+                                         + (1 << (RS_COEF_BITS * 2 - 1))) >> (RS_COEF_BITS * 2));
+            }
+        }
+    }
+    return;
+}
+
+/**
+ * @brief 区域插值: 每个输出像素取其在源图像中覆盖区域内像素的加权均值,
+ * 部分覆盖的像素按覆盖比例加权.
+ * 列方向的坐标与权重对所有行都相同, 预先计算一次存入scratch, 第i列的各项
+ * 位于xPos[xStart[i]]至xPos[xStart[i+1]-1]. 各列覆盖的源图像坐标(截断后)
+ * 依次排列, 相邻两列至多共用一个坐标, 同一列中截断到同一坐标的项已合并,
+ * 因此总项数不超过srcWidth + dstWidth - 1
+ */
+static void resampleArea(const RS_Image *src, int x, int y, int width, int height,
+                         unsigned char *dst, int dstWidth, int dstHeight, int dstStride, RS_Scratch *scratch)
+{
+    int xStart[RS_MAX_SIZE + 1], yPos[RS_MAX_TAPS];
+    float yWeight[RS_MAX_TAPS];
+    int *xPos = scratch->pos;
+    float *xWeight = scratch->weight;
+    double scaleX = (double)width / dstWidth;
+    double scaleY = (double)height / dstHeight;
+    int pixelSize = getPixelSize(src->format);
+    int i, j, m, n;
+    xStart[0] = 0;
+    for(i = 0; i < dstWidth; i++)
+    {
+        int nx = getAreaTaps(i, scaleX, width, x, src->width, xPos + xStart[i], xWeight + xStart[i]);
+        for(n = xStart[i]; n < xStart[i] + nx; n++)
+            xPos[n] *= pixelSize;
+        xStart[i + 1] = xStart[i] + nx;
+        assert(xStart[i + 1] <= scratch->capacity);
+    }
+    for(j = 0; j < dstHeight; j++)
+    {
+        unsigned char *pd = dst + j * dstStride;
+        int ny = getAreaTaps(j, scaleY, height, y, src->height, yPos, yWeight);
+        for(i = 0; i < dstWidth; i++)
+        {
+            float sum = 0;
+            for(m = 0; m < ny; m++)
+            {
+                const unsigned char *ps = src->data + yPos[m] * src->stride;
+                float rowSum = 0;
+                for(n = xStart[i]; n < xStart[i + 1]; n++)
+                    rowSum += loadGray(ps + xPos[n], src->format) * xWeight[n];
+                sum += rowSum * yWeight[m];
+            }
+            pd[i] = (unsigned char)RS_MIN(RS_MAX((int)(sum + 0.5f), 0), 255);
+        }
+    }
+    return;
+}
+
+/**
+ * @brief 每个像素占用的字节数
+ */
+static __inline int getPixelSize(int format)
+{
+    return (format == RS_FORMAT_BGR) ? 3 : ((format == RS_FORMAT_YUYV) ? 2 : 1);
+}
+
+/**
+ * @brief 读取一个像素的灰度值, BGR像素按cv::cvtColor的定点系数转换,
+ * 灰度与YUYV像素直接取首字节(亮度)
+ */
+static __inline int loadGray(const unsigned char *p, int format)
+{
+    if(format != RS_FORMAT_BGR)
+        return p[0];
+    return (p[0] * RS_GRAY_B + p[1] * RS_GRAY_G + p[2] * RS_GRAY_R
+            + (1 << (RS_GRAY_SHIFT - 1))) >> RS_GRAY_SHIFT;
+}
+
+/**
+ * @brief 计算双线性插值中输出第d个像素在源图像中的两个相邻坐标及权重,
+ * 坐标映射与cv::resize一致: 先截断在区域[0, len-1]内, 再截断在图像[0, limit-1]内
+ * @param d 输出坐标
+ * @param scale 缩放比例(区域尺寸 / 输出尺寸)
+ * @param len 区域尺寸
+ * @param origin 区域起点在源图像中的坐标
+ * @param limit 源图像尺寸
+ * @param p0 第一个相邻像素的坐标
+ * @param p1 第二个相邻像素的坐标
+ * @param alpha 第二个像素的权重(放大RS_COEF_SCALE倍)
+ */
+static void getLinearTap(int d, double scale, int len, int origin, int limit, int *p0, int *p1, int *alpha)
+{
+    float f = (float)((d + 0.5) * scale - 0.5);
+    int s = (int)floor(f);
+    f -= s;
+    if(s < 0)
+    {
+        f = 0;
+        s = 0;
+    }
+    if(s >= len - 1)
+    {
+        f = 0;
+        s = len - 1;
+    }
+    *p0 = RS_MIN(RS_MAX(origin + s, 0), limit - 1);
+    *p1 = RS_MIN(RS_MAX(origin + RS_MIN(s + 1, len - 1), 0), limit - 1);
+    *alpha = (int)(f * RS_COEF_SCALE + 0.5f);
+    return;
+}
+
+/**
+ * @brief 计算区域插值中输出第d个像素覆盖的源图像坐标及权重, 权重之和为1
+ * @param d 输出坐标
+ * @param scale 缩放比例(区域尺寸 / 输出尺寸), 不小于1
+ * @param len 区域尺寸
+ * @param origin 区域起点在源图像中的坐标
+ * @param limit 源图像尺寸
+ * @param pos 输出的源图像坐标, 已截断在[0, limit-1]内, 截断到同一坐标的项合并为一项
+ * @param weight 输出的权重
+ * @return 坐标个数
+ */
+static int getAreaTaps(int d, double scale, int len, int origin, int limit, int *pos, float *weight)
+{
+    double f1 = d * scale;
+    double f2 = f1 + scale;
+    double cell = RS_MIN(scale, len - f1);
+    int s1 = (int)ceil(f1);
+    int s2 = (int)floor(f2);
+    int s, n = 0;
+    s2 = RS_MIN(s2, len - 1);
+    s1 = RS_MIN(s1, s2);
+    assert(scale + 2 <= RS_MAX_TAPS);
+#define RS_CLAMP_POS(s) RS_MIN(RS_MAX(origin + (s), 0), limit - 1)
+    if(s1 - f1 > 1e-3)
+        n = addAreaTap(pos, weight, n, RS_CLAMP_POS(s1 - 1), (float)((s1 - f1) / cell));
+    for(s = s1; s < s2; s++)
+        n = addAreaTap(pos, weight, n, RS_CLAMP_POS(s), (float)(1.0 / cell));
+    if(f2 - s2 > 1e-3)
+        n = addAreaTap(pos, weight, n, RS_CLAMP_POS(s2), (float)(RS_MIN(RS_MIN(f2 - s2, 1.0), cell) / cell));
+#undef RS_CLAMP_POS
+    return n;
+}
+
+/**
+ * @brief 追加一项区域插值的坐标与权重, 与上一项坐标相同(区域超出图像, 截断
+ * 到边界)时把权重累加到上一项
+ * @return 追加后的项数
+ */
+static __inline int addAreaTap(int *pos, float *weight, int n, int p, float w)
+{
+    if(n > 0 && pos[n - 1] == p)
+    {
+        weight[n - 1] += w;
+        return n;
+    }
+    pos[n] = p;
+    weight[n] = w;
+    return n + 1;
+}
@@ -0,0 +1,65 @@
+/*
+ * resample.h与resample.c实现了从整帧图像中直接采样出固定尺寸图像块的过程.
+ * 跟踪时每一帧都要截取以目标为中心的搜索窗口(可能远大于模板), 再缩放到
+ * 固定的模板尺寸. 若先截取(超出图像的部分复制边界)再缩放, 需要完整地复制
+ * 一遍搜索窗口. 这里把截取, 边界复制与缩放合成一步: 对输出图像块的每个像素,
+ * 直接计算其在原图中的坐标并插值, 坐标超出窗口或图像时按边界复制的规则截断,
+ * 双线性插值的计算量只与输出尺寸有关, 与目标尺寸无关.
+ * 双线性插值的坐标映射与cv::resize(INTER_LINEAR)一致, 权重采用11位定点数,
+ * 与OpenCV的定点实现相比, 个别像素可能有1个灰度级的差异.
+ * 区域插值(RS_AREA)用于大比例缩小, 每个输出像素取其在原图中覆盖区域的加权
+ * 均值, 放大时退化为双线性插值, 与cv::resize(INTER_AREA)的行为相同.
+ * 源图像可以是BGR彩色图像, 此时只对采样到的像素做灰度转换(系数与
+ * cv::cvtColor(CV_BGR2GRAY)的定点实现相同), 无需预先转换整帧. YUV图像
+ * 直接读取亮度: NV12与I420的Y平面按灰度图像处理, YUYV按2字节步长读取Y.
+ */
+
+#ifndef RESAMPLE_H
+#define RESAMPLE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif //__cplusplus
+
+#define RS_BILINEAR 0           //双线性插值
+#define RS_AREA     1           //区域插值
+
+#define RS_FORMAT_GRAY 0        //单通道8位灰度图像
+#define RS_FORMAT_BGR  1        //3通道8位BGR图像, 采样时转换为灰度
+#define RS_FORMAT_YUYV 2        //YUYV打包图像(Y0 U Y1 V), 只读取亮度
+
+#define RS_MAX_SIZE 2048        //输出图像块的最大边长
+
+#define RS_COEF_BITS 11
+#define RS_COEF_SCALE (1 << RS_COEF_BITS)
+
+typedef struct RS_Image
+{
+    const unsigned char *data;  //图像数据首地址
+    int width;                  //宽度(像素)
+    int height;                 //高度(像素)
+    int stride;                 //相邻两行首地址之间的字节数
+    int format;                 //像素格式, 见RS_FORMAT_*
+} RS_Image;
+
+/* 区域插值预先计算的各列坐标与权重, 由调用者持有并重复使用 */
+typedef struct RS_Scratch
+{
+    int *pos;                   //各列覆盖的源图像字节偏移
+    float *weight;              //对应的权重
+    int capacity;               //pos与weight的项数
+} RS_Scratch;
+
+void resamplePatch(const RS_Image *src, int x, int y, int width, int height,
+                   unsigned char *dst, int dstWidth, int dstHeight, int dstStride, int method,
+                   RS_Scratch *scratch);
+
+void reserveResampleScratch(RS_Scratch *scratch, int srcWidth, int dstWidth);
+
+void freeResampleScratch(RS_Scratch *scratch);
+
+#ifdef __cplusplus
+}
+#endif //__cplusplus
+
+#endif // RESAMPLE_H
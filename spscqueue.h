@@ -0,0 +1,62 @@
+#ifndef SPSCQUEUE_H
+#define SPSCQUEUE_H
+
+#include <atomic>
+
+/*
+ * 单生产者单消费者的无锁环形队列, 容量N须为2的幂.
+ * 生产者只写tail, 消费者只写head, 二者各自以release语义发布, 以acquire语义
+ * 读取对方的位置, 因此元素的写入总在位置发布之前对另一方可见. head与tail
+ * 分处不同的缓存行, 避免两个线程互相使对方的缓存行失效.
+ * 队列满时push返回false, 由生产者决定丢弃或重试, 不会阻塞.
+ */
+template <typename T, unsigned N>
+class SpscQueue
+{
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "SpscQueue capacity must be a power of two");
+
+public:
+    SpscQueue() : head(0), tail(0) {}
+
+    /**
+     * @brief 入队, 只能由生产者线程调用
+     * @return 队列已满时返回false
+     */
+    bool push(const T &item)
+    {
+        unsigned t = tail.load(std::memory_order_relaxed);
+        if(t - head.load(std::memory_order_acquire) == N)
+            return false;
+        items[t & (N - 1)] = item;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief 出队, 只能由消费者线程调用. 出队后清空该位置, 及时释放元素持有的资源
+     * @return 队列为空时返回false
+     */
+    bool pop(T &item)
+    {
+        unsigned h = head.load(std::memory_order_relaxed);
+        if(h == tail.load(std::memory_order_acquire))
+            return false;
+        item = items[h & (N - 1)];
+        items[h & (N - 1)] = T();
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool empty() const
+    {
+        return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+    }
+
+private:
+    T items[N];
+    std::atomic<unsigned> head;     //消费者的读位置
+    char pad[64];
+    std::atomic<unsigned> tail;     //生产者的写位置
+};
+
+#endif // SPSCQUEUE_H
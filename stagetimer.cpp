@@ -0,0 +1,162 @@
+#include <string.h>
+#include <math.h>
+#include <opencv2/core.hpp>
+
+#include "stagetimer.h"
+
+using namespace cv;
+
+static const char *STAGE_NAMES[STAGE_COUNT] = {
+    "patch", "hog", "fft2",
+    "kernel", "ifft2", "peak", "logpolar", "update", "frame"
+};
+
+/**
+ * @brief 计算耗时所在的桶: 小于2^(STAGE_SUB_BITS+1)的值各占一个桶,
+ * 更大的值按最高位所在的2倍区间分组, 每组再按次高的STAGE_SUB_BITS位细分
+ * @param v 耗时(ns)
+ * @return 桶序号
+ */
+static int getBucket(int64 v)
+{
+    int e = 0;
+    if(v < 0)
+        v = 0;
+    while(v >= (2 << STAGE_SUB_BITS))
+    {
+        v >>= 1;
+        e++;
+    }
+    int b = (e << STAGE_SUB_BITS) + (int)v;
+    return MIN(b, STAGE_BUCKETS - 1);
+}
+
+/**
+ * @brief 桶的下界(ns), 与getBucket互逆
+ */
+static double getBucketLow(int b)
+{
+    if(b < (2 << STAGE_SUB_BITS))
+        return b;
+    int e = (b >> STAGE_SUB_BITS) - 1;
+    int m = (b & ((1 << STAGE_SUB_BITS) - 1)) + (1 << STAGE_SUB_BITS);
+    return (double)m * ((int64)1 << e);
+}
+
+StageProfiler::StageProfiler()
+{
+    enabled = false;
+    nsPerTick = 1e9 / getTickFrequency();
+    reset();
+}
+
+void StageProfiler::setEnabled(bool enable)
+{
+    enabled = enable;
+    memset(frameTicks, 0, sizeof(frameTicks));
+}
+
+void StageProfiler::reset()
+{
+    memset(frameTicks, 0, sizeof(frameTicks));
+    memset(hist, 0, sizeof(hist));
+    memset(count, 0, sizeof(count));
+    memset(totalNs, 0, sizeof(totalNs));
+    memset(maxNs, 0, sizeof(maxNs));
+}
+
+/**
+ * @brief 结束一帧: 本帧中执行过的阶段各记一个样本, 然后清空帧内累加
+ */
+void StageProfiler::endFrame()
+{
+    if(!enabled)
+        return;
+    for(int i = 0; i < STAGE_COUNT; i++)
+    {
+        if(frameTicks[i] == 0)
+            continue;
+        record(i, (int64)(frameTicks[i] * nsPerTick));
+        frameTicks[i] = 0;
+    }
+}
+
+/**
+ * @brief 丢弃当前帧内已累加的耗时, 用于不计入统计的过程(如初始化)
+ */
+void StageProfiler::discardFrame()
+{
+    memset(frameTicks, 0, sizeof(frameTicks));
+}
+
+void StageProfiler::record(int stage, int64 ns)
+{
+    hist[stage][getBucket(ns)]++;
+    count[stage]++;
+    totalNs[stage] += ns;
+    maxNs[stage] = MAX(maxNs[stage], ns);
+}
+
+/**
+ * @brief 获取某一阶段的百分位数
+ * @param stage 阶段, 见TrackStage
+ * @param p 百分位, 0~1
+ * @return 耗时(us), 取所在桶的中点
+ */
+double StageProfiler::getPercentile(int stage, double p) const
+{
+    CV_Assert(stage >= 0 && stage < STAGE_COUNT);
+    if(count[stage] == 0)
+        return 0;
+    int64 rank = (int64)ceil(p * count[stage]);
+    rank = MAX(rank, (int64)1);
+    int64 seen = 0;
+    for(int b = 0; b < STAGE_BUCKETS; b++)
+    {
+        seen += hist[stage][b];
+        if(seen >= rank)
+        {
+            double mid = 0.5 * (getBucketLow(b) + getBucketLow(b + 1));
+            return MIN(mid, (double)maxNs[stage]) * 1e-3;
+        }
+    }
+    return maxNs[stage] * 1e-3;
+}
+
+StageStats StageProfiler::getStats(int stage) const
+{
+    CV_Assert(stage >= 0 && stage < STAGE_COUNT);
+    StageStats stats;
+    stats.count = count[stage];
+    stats.meanUs = count[stage] ? totalNs[stage] / count[stage] * 1e-3 : 0;
+    stats.p50Us = getPercentile(stage, 0.5);
+    stats.p99Us = getPercentile(stage, 0.99);
+    stats.maxUs = maxNs[stage] * 1e-3;
+    return stats;
+}
+
+/**
+ * @brief 以表格形式输出各阶段的统计结果
+ * @param fp 输出文件
+ * @param title 表头, 一般为跟踪器的名称
+ */
+void StageProfiler::dump(FILE *fp, const char *title) const
+{
+    fprintf(fp, "%s\n", title ? title : "stage timing");
+    fprintf(fp, "%-10s %8s %10s %10s %10s %10s\n", "stage", "frames", "mean(us)", "p50(us)", "p99(us)", "max(us)");
+    for(int i = 0; i < STAGE_COUNT; i++)
+    {
+        if(count[i] == 0)
+            continue;
+        StageStats s = getStats(i);
+        fprintf(fp, "%-10s %8d %10.1f %10.1f %10.1f %10.1f\n",
+                STAGE_NAMES[i], s.count, s.meanUs, s.p50Us, s.p99Us, s.maxUs);
+    }
+    fflush(fp);
+}
+
+const char* StageProfiler::getStageName(int stage)
+{
+    CV_Assert(stage >= 0 && stage < STAGE_COUNT);
+    return STAGE_NAMES[stage];
+}
@@ -0,0 +1,113 @@
+#ifndef STAGETIMER_H
+#define STAGETIMER_H
+
+#include <stdio.h>
+#include <opencv2/core.hpp>
+
+/*
+ * 跟踪流程各阶段的耗时统计.
+ * 每个跟踪器持有一个StageProfiler, 流程中的各阶段用STAGE_TIMER在作用域内
+ * 计时. 同一阶段在一帧内可能被执行多次(如平移与尺度两个分支都要做fft2),
+ * 这些耗时先在帧内累加, 帧结束时(endFrame)每个阶段记一个样本, 写入该阶段
+ * 的对数分桶直方图, 因此统计量都是"每帧在该阶段上花费的时间".
+ * 各阶段互不嵌套, 阶段耗时之和加上未计时的部分即为整帧耗时(STAGE_FRAME);
+ * 平移与尺度分支并行训练时, 阶段耗时按两个线程分别累加, 其和可能大于整帧耗时.
+ * 未开启时STAGE_TIMER只多一次判断, 定义FSCT_NO_PROFILE则完全不编译计时代码.
+ * 帧内累加(add)加锁, 可在同一跟踪器的多个线程中调用, 其余接口须在
+ * 调用trackEachFrame的线程中使用.
+ */
+
+enum TrackStage
+{
+    STAGE_PATCH = 0,    //截取并缩放图像块(含灰度转换)
+    STAGE_HOG,          //HOG特征(含余弦窗加权)
+    STAGE_FFT,          //正变换
+    STAGE_KERNEL,       //核相关(频谱共轭相乘求和, 高斯核, 响应频谱)
+    STAGE_IFFT,         //逆变换
+    STAGE_PEAK,         //峰值搜索与亚像素定位
+    STAGE_LPT,          //对数极坐标采样(直接取自整帧)
+    STAGE_UPDATE,       //训练系数与模型更新
+    STAGE_FRAME,        //整帧
+    STAGE_COUNT
+};
+
+#define STAGE_SUB_BITS 3    //每个2倍区间再细分为2^STAGE_SUB_BITS个桶, 相对误差约6%
+#define STAGE_BUCKETS 320   //以ns计可覆盖到约2^39ns(9分钟)
+
+typedef struct StageStats
+{
+    int count;      //样本(帧)数
+    double meanUs;  //平均耗时(us)
+    double p50Us;   //中位数(us)
+    double p99Us;   //99%分位数(us)
+    double maxUs;   //最大耗时(us)
+} StageStats;
+
+class StageProfiler
+{
+private:
+    bool enabled;
+    double nsPerTick;
+    int64 frameTicks[STAGE_COUNT];
+    unsigned int hist[STAGE_COUNT][STAGE_BUCKETS];
+    int count[STAGE_COUNT];
+    double totalNs[STAGE_COUNT];
+    int64 maxNs[STAGE_COUNT];
+    cv::Mutex addLock;
+
+public:
+    StageProfiler();
+
+    void setEnabled(bool enable);
+    bool isEnabled() const { return enabled; }
+    void reset();
+    void add(int stage, int64 ticks)
+    {
+        cv::AutoLock lock(addLock);
+        frameTicks[stage] += ticks;
+    }
+    void endFrame();
+    void discardFrame();
+
+    StageStats getStats(int stage) const;
+    double getPercentile(int stage, double p) const;
+    void dump(FILE *fp, const char *title) const;
+
+    static const char* getStageName(int stage);
+private:
+    void record(int stage, int64 ns);
+};
+
+/*
+ * 作用域计时器, 构造时读取时钟, 析构时将耗时累加到StageProfiler的当前帧中
+ */
+class StageTimer
+{
+private:
+    StageProfiler *profiler;
+    int stage;
+    int64 start;
+
+public:
+    StageTimer(StageProfiler *profiler, int stage)
+        : profiler(profiler->isEnabled() ? profiler : NULL), stage(stage), start(0)
+    {
+        if(this->profiler)
+            start = cv::getTickCount();
+    }
+    ~StageTimer()
+    {
+        if(profiler)
+            profiler->add(stage, cv::getTickCount() - start);
+    }
+};
+
+#ifdef FSCT_NO_PROFILE
+#define STAGE_TIMER(profiler, stage)
+#else
+#define STAGE_TIMER_NAME2(line) stageTimer##line
+#define STAGE_TIMER_NAME(line) STAGE_TIMER_NAME2(line)
+#define STAGE_TIMER(profiler, stage) StageTimer STAGE_TIMER_NAME(__LINE__)(profiler, stage)
+#endif
+
+#endif // STAGETIMER_H
@@ -0,0 +1,188 @@
+#include <assert.h>
+#include <QDebug>
+#include <opencv2/imgproc.hpp>
+
+#include "trackworker.h"
+
+TrackWorker::TrackWorker(QObject *parent) :
+    QThread(parent)
+{
+    tracker = NULL;
+    source = NULL;
+    frameNum = 0;
+    frameCount = 0;
+    stopRequested = false;
+    dropped = 0;
+    for(int i = 0; i < TRACK_DISPLAY_BUFFERS; i++)
+        freeDisplays.push(i);
+    pendingDisplay = -1;
+    shownDisplay = -1;
+}
+
+TrackWorker::~TrackWorker()
+{
+    stop();
+}
+
+/**
+ * @brief 设置跟踪线程的输入, 须在start之前由界面线程调用. 上一次运行留在
+ * 结果队列中的结果被丢弃, 其显示缓存归还给空闲队列
+ * @param tracker 已初始化目标的跟踪器
+ * @param source 已打开的帧源
+ * @param target 当前的目标位置
+ * @param frameNum 下一帧的序号
+ * @param frameCount 总帧数, 序号达到该值时结束
+ * @param frameArea 帧图像的显示区域, 帧图像按比例缩小到该区域内
+ * @param appArea 外观图像的显示区域
+ */
+void TrackWorker::setup(CorrTrack *tracker, FrameSource *source, const cv::Rect &target, int frameNum, int frameCount,
+                        const QSize &frameArea, const QSize &appArea)
+{
+    assert(!isRunning());
+    TrackResult stale;
+    fetchLatest(stale);
+    this->tracker = tracker;
+    this->source = source;
+    this->targetRect = target;
+    this->frameNum = frameNum;
+    this->frameCount = frameCount;
+    this->frameArea = frameArea;
+    this->appArea = appArea;
+    stopRequested = false;
+}
+
+/**
+ * @brief 请求停止并等待跟踪线程结束, 当前帧跟踪完毕后才会退出
+ */
+void TrackWorker::stop()
+{
+    stopRequested = true;
+    wait();
+}
+
+/**
+ * @brief 取出最新的跟踪结果, 丢弃更早的结果, 由界面线程调用.
+ * 被取代的结果及之前显示的结果的显示缓存归还给跟踪线程
+ * @return 没有新结果时返回false
+ */
+bool TrackWorker::fetchLatest(TrackResult &result)
+{
+    bool got = false;
+    TrackResult res;
+    while(results.pop(res))
+    {
+        if(res.display >= 0)
+        {
+            if(shownDisplay >= 0)
+                freeDisplays.push(shownDisplay);
+            shownDisplay = res.display;
+        }
+        result = res;
+        got = true;
+    }
+    return got;
+}
+
+/**
+ * @brief 结果对应的显示缓存, 由界面线程调用, 在下一次fetchLatest取得新结果之前有效
+ */
+TrackDisplay& TrackWorker::getDisplay(int idx)
+{
+    assert(idx >= 0 && idx < TRACK_DISPLAY_BUFFERS);
+    return displays[idx];
+}
+
+/**
+ * @brief 下一帧的序号, 在stop之后有效
+ */
+int TrackWorker::getFrameNum() const
+{
+    return frameNum;
+}
+
+/**
+ * @brief 最近一帧的跟踪结果, 在stop之后有效
+ */
+cv::Rect TrackWorker::getTargetRect() const
+{
+    return targetRect;
+}
+
+int TrackWorker::getDroppedCount() const
+{
+    return dropped;
+}
+
+void TrackWorker::run()
+{
+    assert(tracker != NULL && source != NULL);
+    while(!stopRequested && frameNum < frameCount)
+    {
+        cv::Mat frameBuf;
+        int64 t = cv::getTickCount();
+        if(!source->acquire(frameBuf))
+            break;
+        tracker->trackEachFrame(frameBuf, targetRect);
+        t = cv::getTickCount() - t;
+
+        TrackResult res;
+        res.frameNum = frameNum;
+        res.rect = targetRect;
+        res.fps = (int)(cv::getTickFrequency() / MAX_VAL(t, 1));
+        res.zoom = 1;
+        if(pendingDisplay < 0 && !freeDisplays.pop(pendingDisplay))
+            pendingDisplay = -1;
+        res.display = pendingDisplay;
+        if(res.display >= 0)
+        {
+            TrackDisplay &d = displays[res.display];
+            res.zoom = renderImage(frameBuf, frameArea, d.frame, frameScaleBuf);
+            renderImage(tracker->globalApp, appArea, d.globalApp, appScaleBuf);
+            renderImage(tracker->currentApp, appArea, d.currentApp, appScaleBuf);
+        }
+        if(results.push(res))
+            pendingDisplay = -1; //显示缓存随结果交给界面线程
+        else
+            dropped++;
+        frameNum++;
+    }
+}
+
+/**
+ * @brief 把Mat按比例缩小到显示区域内, 写入RGB32格式的显示图像.
+ * RGB32在内存中的字节顺序为B, G, R, A, 与OpenCV的BGRA一致, 因此不需要交换
+ * 红蓝通道. 不缩放时颜色转换直接写入显示图像, 只有一遍; 缩小时先缩小到
+ * scaleBuf, 再转换写入显示图像, 共两遍, 第二遍只处理缩小后的像素.
+ * 显示图像与中间结果的尺寸不变时不申请内存
+ * @param mat 8位灰度或BGR图像
+ * @param area 显示区域
+ * @param image 输出的显示图像
+ * @param scaleBuf 缩放的中间结果
+ * @return 缩放比例, 不大于1
+ */
+double renderImage(const cv::Mat &mat, const QSize &area, QImage &image, cv::Mat &scaleBuf)
+{
+    if(mat.empty())
+        return 1;
+    if(mat.type() != CV_8UC1 && mat.type() != CV_8UC3)
+    {
+        qDebug() << "ERROR: Mat could not be converted to QImage.";
+        return 1;
+    }
+    double zoom = 1;
+    if(mat.cols > area.width() || mat.rows > area.height())
+        zoom = MIN(1.0 * area.width() / mat.cols, 1.0 * area.height() / mat.rows);
+    int width = MAX_VAL(cvRound(mat.cols * zoom), 1);
+    int height = MAX_VAL(cvRound(mat.rows * zoom), 1);
+    if(image.width() != width || image.height() != height || image.format() != QImage::Format_RGB32)
+        image = QImage(width, height, QImage::Format_RGB32);
+    cv::Mat view(height, width, CV_8UC4, image.bits(), image.bytesPerLine());
+    const cv::Mat *src = &mat;
+    if(zoom < 1)
+    {
+        cv::resize(mat, scaleBuf, cv::Size(width, height), 0, 0, cv::INTER_AREA);
+        src = &scaleBuf;
+    }
+    cv::cvtColor(*src, view, src->channels() == 1 ? cv::COLOR_GRAY2BGRA : cv::COLOR_BGR2BGRA);
+    return zoom;
+}
@@ -0,0 +1,85 @@
+#ifndef TRACKWORKER_H
+#define TRACKWORKER_H
+
+#include <atomic>
+#include <QThread>
+#include <QImage>
+#include <QSize>
+#include <opencv2/core.hpp>
+
+#include "corrtrack.h"
+#include "framesource.h"
+#include "spscqueue.h"
+
+#define TRACK_DISPLAY_BUFFERS 8    //显示缓存个数, 不少于结果队列容量+2, 且为2的幂
+
+typedef struct TrackResult
+{
+    int frameNum;       //帧序号
+    cv::Rect rect;      //跟踪结果
+    int fps;            //取帧与跟踪的帧率
+    double zoom;        //帧图像的显示缩放比例
+    int display;        //显示缓存的序号, -1表示没有空闲的显示缓存, 该帧不显示
+} TrackResult;
+
+typedef struct TrackDisplay
+{
+    QImage frame;       //缩放后的帧图像
+    QImage globalApp;   //全局外观模型
+    QImage currentApp;  //当前帧外观
+} TrackDisplay;
+
+/*
+ * 跟踪线程. 取帧, 跟踪以及帧与外观图像的缩放都在该线程中进行,
+ * 结果通过无锁队列交给界面线程, 界面只负责绘制. 界面刷新慢于跟踪时,
+ * fetchLatest只取最新的结果, 其余的直接丢弃; 队列满时跟踪线程丢弃新结果,
+ * 不等待界面.
+ * 显示图像写入固定的一组显示缓存, 缓存的所有权随序号在两个线程间传递:
+ * 跟踪线程从空闲队列取出序号写入图像, 随结果交给界面; 界面在该结果被
+ * 更新的结果取代时把序号放回空闲队列. 缓存尺寸不变时不申请内存.
+ * 运行期间跟踪器与帧源只由该线程访问, 界面须在stop之后才能再使用它们.
+ */
+class TrackWorker : public QThread
+{
+    Q_OBJECT
+
+public:
+    explicit TrackWorker(QObject *parent = 0);
+    ~TrackWorker();
+
+    void setup(CorrTrack *tracker, FrameSource *source, const cv::Rect &target, int frameNum, int frameCount,
+               const QSize &frameArea, const QSize &appArea);
+    void stop();
+    bool fetchLatest(TrackResult &result);
+    TrackDisplay& getDisplay(int idx);
+
+    int getFrameNum() const;
+    cv::Rect getTargetRect() const;
+    int getDroppedCount() const;
+
+protected:
+    void run();
+
+private:
+    CorrTrack *tracker;
+    FrameSource *source;
+    cv::Rect targetRect;
+    int frameNum;       //下一帧的序号
+    int frameCount;
+    QSize frameArea;    //帧图像的显示区域
+    QSize appArea;      //外观图像的显示区域
+    std::atomic<bool> stopRequested;
+    std::atomic<int> dropped;
+    SpscQueue<TrackResult, 4> results;
+
+    TrackDisplay displays[TRACK_DISPLAY_BUFFERS];
+    SpscQueue<int, TRACK_DISPLAY_BUFFERS> freeDisplays;   //界面线程归还的空闲显示缓存
+    int pendingDisplay;     //跟踪线程已取出但未交出的显示缓存
+    int shownDisplay;       //界面线程正在显示的缓存
+    cv::Mat frameScaleBuf;  //缩放的中间结果, 只由跟踪线程使用
+    cv::Mat appScaleBuf;
+};
+
+double renderImage(const cv::Mat &mat, const QSize &area, QImage &image, cv::Mat &scaleBuf);
+
+#endif // TRACKWORKER_H
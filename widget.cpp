@@ -18,7 +18,6 @@
 #include <QFileDialog>
 #include <QDir>
 #include <QFile>
-#include <QPixmap>
 #include <QImage>
 #include <QPainter>
 #include <QRect>
@@ -35,6 +34,12 @@ Widget::Widget(QWidget *parent) :
     ui(new Ui::Widget)
 {
     ui->setupUi(this);
+    QLabel *views[3] = {ui->labelFrame, ui->labelGlbApp, ui->labelCurApp};
+    for(int i = 0; i < 3; i++)
+    {
+        shownImages.insert(views[i], NULL);
+        views[i]->installEventFilter(this);
+    }
     param = new TrackParam;
     setDefaultParam();
     setUiParamProperty();
@@ -79,16 +84,17 @@ Widget::Widget(QWidget *parent) :
     ui->lcdNumberFps->setSegmentStyle(QLCDNumber::Flat);
     ui->lcdNumberFps->setPalette(lcdpat);
 
-    time = new QTime;
     fsct = new CorrTrack;
+    worker = new TrackWorker;
+    frameZoom = 1;
 
 }
 
 Widget::~Widget()
 {
+    delete worker; //先停止跟踪线程, 再释放它使用的跟踪器
     delete timerTrack;
     delete timerPlay;
-    delete time;
     delete fsct;
     delete param;
     delete ui;
@@ -113,31 +119,37 @@ void Widget::showPlayFrame()
     if(frameNum < frameCount)
     {
         fillFrameBuf();
-        showPlayImage(frameBuf, frame, ui->labelFrame);
+        frameZoom = showPlayImage(frameBuf, frame, ui->labelFrame);
         frameNum++;
         ui->lcdNumberFrame->display(frameNum-1);
         timerPlay->start(20);
     }
 }
 
+/**
+ * @brief 界面刷新定时器的响应函数. 取帧与跟踪在TrackWorker中进行, 这里只
+ * 绘制最新的一个结果, 跟踪线程结束且没有新结果时停止刷新
+ */
 void Widget::showTrackingFrame()
 {
-    if(frameNum < frameCount)
+    TrackResult res;
+    if(!worker->fetchLatest(res))
     {
-        time->start();
-        fillFrameBuf();
-
-        fsct->trackEachFrame(frameBuf, targetRect);
-
-        showTrackingImage(frameBuf, frame, ui->labelFrame);
-        showPlayImage(fsct->globalApp, glbApp, ui->labelGlbApp);
-        showPlayImage(fsct->currentApp, curApp, ui->labelCurApp);
-        int fps = 1000 / time->elapsed();
-        frameNum++;
-        ui->lcdNumberFrame->display(frameNum-1);
-        ui->lcdNumberFps->display(fps);
-        timerTrack->start(1);
+        if(worker->isFinished())
+            timerTrack->stop();
+        return;
+    }
+    targetRect = res.rect;
+    frameNum = res.frameNum + 1;
+    if(res.display >= 0) //没有空闲显示缓存的帧只更新计数
+    {
+        TrackDisplay &d = worker->getDisplay(res.display);
+        showTrackingImage(d.frame, ui->labelFrame, res.frameNum, res.zoom);
+        showImage(&d.globalApp, ui->labelGlbApp);
+        showImage(&d.currentApp, ui->labelCurApp);
     }
+    ui->lcdNumberFrame->display(res.frameNum);
+    ui->lcdNumberFps->display(res.fps);
 }
 
 void Widget::setDefaultParam()
@@ -153,6 +165,11 @@ void Widget::setDefaultParam()
     param->scaleCellSz = 4;
     param->scaleGaussSigmaRate = 28;
     param->scaleLearnRate = 0.02;
+    param->useHalfSpectrum = false;
+    param->reuseFeatures = false;
+    param->sampleMethod = RS_BILINEAR;
+    param->parallelBranches = false;
+    param->parallelHog = false;
 }
 
 void Widget::getParamFromUi()
@@ -226,10 +243,7 @@ void Widget::setInputWidgetAvaliable(bool avaliable)
 
 void Widget::fillFrameBuf()
 {
-    if(ui->comboBoxSource->currentIndex() != 2)
-        video >> frameBuf;
-    else
-        frameBuf = cv::imread(picSeq.at(frameNum).toStdString());
+    source.acquire(frameBuf); //解码在后台线程进行, 帧数据在下一次取帧前有效
 }
 
 void Widget::openInputSource()
@@ -237,16 +251,14 @@ void Widget::openInputSource()
     switch(ui->comboBoxSource->currentIndex())
     {
     case 0:
-        video.open(0);
-        if(!video.isOpened())
+        if(!source.openCamera(0, FRAME_POLICY_LATEST))
             qDebug() << "Can not initialize camera!";
         frameCount = 9999;
         break;
     case 1:
-        video.open(ui->lineEditPath->text().toStdString());
-        if(!video.isOpened())
+        if(!source.openVideo(ui->lineEditPath->text().toStdString(), FRAME_POLICY_BLOCK))
             qDebug() << "Can not open video file!";
-        frameCount = (int)video.get(cv::CAP_PROP_FRAME_COUNT) - 1;
+        frameCount = source.getFrameCount() - 1;
         break;
     case 2:
         if(!picSeq.isEmpty())
@@ -257,6 +269,13 @@ void Widget::openInputSource()
         if(!ui->checkBoxInitManu->isChecked())
             readGroundTruth();
         frameCount = picSeq.length() - 1;
+        {
+            std::vector<std::string> files;
+            for(int i = 0; i < picSeq.length(); i++)
+                files.push_back(picSeq.at(i).toStdString());
+            if(!source.openSequence(files))
+                qDebug() << "Can not read image sequence!";
+        }
         break;
     }
 }
@@ -314,101 +333,72 @@ void Widget::readGroundTruth()
     }
 }
 
-QImage Widget::cvMat2QImage(const cv::Mat& mat)
+/**
+ * @brief 显示播放的帧, 缩放结果写入持久的显示图像, 尺寸不变时不申请内存
+ * @return 缩放比例
+ */
+double Widget::showPlayImage(const cv::Mat &mat, QImage &frame, QLabel *label)
 {
-    if(mat.type() == CV_8UC1)
-    {
-        QImage image(mat.cols, mat.rows, QImage::Format_Indexed8);
-        image.setColorCount(256);
-        for(int i = 0; i < 256; i++)
-            image.setColor(i, qRgb(i, i, i));
-        uchar *psrc = mat.data;
-        for(int row = 0; row < mat.rows; row ++)
-        {
-            uchar *pdst = image.scanLine(row);
-            memcpy(pdst, psrc, mat.cols);
-            psrc += mat.step;
-        }
-        return image;
-    }
-    else if(mat.type() == CV_8UC3)
-    {
-        const uchar *psrc = (const uchar*)mat.data;
-        QImage image(psrc, mat.cols, mat.rows, mat.step, QImage::Format_RGB888);
-        return image.rgbSwapped();
-    }
-    else
-    {
-        qDebug() << "ERROR: Mat could not be converted to QImage.";
-        return QImage();
-    }
+    double zoom = renderImage(mat, label->size(), frame, playScaleBuf);
+    showImage(&frame, label);
+    return zoom;
 }
 
-void Widget::showPlayImage(const cv::Mat &mat, QImage &frame, QLabel *label)
+/**
+ * @brief 在控件中显示图像. 不生成QPixmap, 只记下图像并请求重绘, 由eventFilter
+ * 把图像直接绘制到控件上, 因此每帧不申请内存也不拷贝图像
+ * @param img 持久的显示图像, 在被下一次showImage取代之前须保持有效, 为NULL时清空
+ * @param label 显示的控件
+ */
+void Widget::showImage(const QImage *img, QLabel *label)
 {
-    QImage img = cvMat2QImage(mat);
-    if(mat.rows <= label->height() && mat.cols <= label->width())
-    {
-        frame = img;
-        label->setPixmap(QPixmap::fromImage(img));
-    }
-    else if((mat.rows > label->height() || mat.cols > label->width())
-            && mat.rows >= mat.cols)
-    {
-        frame = img.scaledToHeight(label->height());
-        label->setPixmap(QPixmap::fromImage(frame));
-    }
-    else if((mat.rows > label->height() || mat.cols > label->width())
-            && mat.rows < mat.cols)
-    {
-        frame = img.scaledToWidth(label->width());
-        label->setPixmap(QPixmap::fromImage(frame));
-    }
-    label->setAlignment(Qt::AlignCenter);
+    shownImages[label] = img;
+    label->update();
 }
 
-void Widget::showTrackingImage(const cv::Mat &mat, QImage &frame, QLabel *label)
+/**
+ * @brief 显示控件的绘图事件: 把showImage记下的图像居中绘制, 之后仍由QLabel绘制边框
+ */
+bool Widget::eventFilter(QObject *obj, QEvent *e)
 {
-    QImage img = cvMat2QImage(mat);
-    QImage scaleImg;
-    double zoom;
-    if(mat.rows <= label->height() && mat.cols <= label->width())
+    if(e->type() == QEvent::Paint && shownImages.contains(obj))
     {
-        scaleImg = img;
-        zoom = 1;
-    }
-    else if((mat.rows > label->height() || mat.cols > label->width())
-            && mat.rows >= mat.cols)
-    {
-        scaleImg = img.scaledToHeight(label->height());
-        zoom = label->height() / mat.rows;
-    }
-    else if((mat.rows > label->height() || mat.cols > label->width())
-            && mat.rows < mat.cols)
-    {
-        scaleImg = img.scaledToWidth(label->width());
-        zoom = label->width() / mat.cols;
+        const QImage *img = shownImages.value(obj);
+        if(img && !img->isNull())
+        {
+            QLabel *label = static_cast<QLabel*>(obj);
+            QRect area = label->contentsRect();
+            QPainter painter(label);
+            painter.drawImage(area.x() + (area.width() - img->width()) / 2,
+                              area.y() + (area.height() - img->height()) / 2, *img);
+        }
     }
-//    QImage convertImg = scaleImg.convertToFormat(QImage::Format_ARGB32_Premultiplied);
-    QPainter painter(&frame);
-    painter.setCompositionMode(QPainter::CompositionMode_Source);
-    painter.drawImage(0, 0, scaleImg);
+    return QWidget::eventFilter(obj, e);
+}
+
+/**
+ * @brief 在跟踪线程缩放好的帧图像上直接绘制真值与跟踪结果
+ * @param img 显示缓存中的帧图像, 在归还之前属于界面线程
+ * @param label 显示的控件
+ * @param index 帧序号, 用于查找真值
+ * @param zoom 帧图像的缩放比例
+ */
+void Widget::showTrackingImage(QImage &img, QLabel *label, int index, double zoom)
+{
+    QPainter painter(&img);
     QRectF gt;
-    if(!groundTruth.isEmpty())
+    if(index >= 0 && index < groundTruth.size())
     {
-        cvRect2QRectF(groundTruth.at(frameNum), gt, zoom);
-        painter.setCompositionMode(QPainter::CompositionMode_SourceOver);
+        cvRect2QRectF(groundTruth.at(index), gt, zoom);
         painter.setPen(QPen(QBrush(Qt::green), 2.0));
         painter.drawRect(gt);
     }
     QRectF tgt;
     cvRect2QRectF(targetRect, tgt, zoom);
-    painter.setCompositionMode(QPainter::CompositionMode_SourceOver);
     painter.setPen(QPen(QBrush(Qt::red), 2.0));
     painter.drawRect(tgt);
     painter.end();
-    label->setPixmap(QPixmap::fromImage(frame));
-    label->setAlignment(Qt::AlignCenter);
+    showImage(&img, label);
 }
 
 void Widget::cvRect2QRectF(const cv::Rect &cvrect, QRectF &qrect, double zoom)
@@ -421,6 +411,9 @@ void Widget::cvRect2QRectF(const cv::Rect &cvrect, QRectF &qrect, double zoom)
 
 void Widget::onPushButtonReset_clicked()
 {
+    worker->stop(); //跟踪线程使用帧源与跟踪器, 须先停止
+    TrackResult stale;
+    worker->fetchLatest(stale); //丢弃上一次跟踪未显示的结果, 避免按新序列的真值绘制
     pushButtonSetParamState = !pushButtonSetParamState; //改变（设置/重置）按钮状态
     if(pushButtonSetParamState) //Set功能
     {
@@ -440,8 +433,7 @@ void Widget::onPushButtonReset_clicked()
         setUiParamProperty(); //设置UI显示参数
         groundTruth.clear();
         picSeq.clear();
-        if(video.isOpened())
-            video.release();
+        source.close();
     }
     pushButtonInitState = false; //重新设置（播放/初始化）按钮功能
     pushButtonTrackingState = false; //重新设置（跟踪）按钮功能
@@ -451,6 +443,7 @@ void Widget::onPushButtonReset_clicked()
     ui->pushButtonTracking->setText(QStringLiteral("跟踪")); //重新设置（跟踪）按钮文字
     ui->pushButtonTracking->setEnabled(false); //设置（跟踪）按钮不可用
     frameNum = 0;    
+    frameZoom = 1;
     m_isDown = false;
     m_start = QPoint(0,0);
     m_stop = QPoint(0,0);
@@ -460,9 +453,9 @@ void Widget::onPushButtonReset_clicked()
     timerTrack->stop();
     ui->lcdNumberFrame->display(0);
     ui->lcdNumberFps->display(0);
-    ui->labelFrame->clear();
-    ui->labelGlbApp->clear();
-    ui->labelCurApp->clear();
+    showImage(NULL, ui->labelFrame);
+    showImage(NULL, ui->labelGlbApp);
+    showImage(NULL, ui->labelCurApp);
 }
 
 void Widget::onPushButtonInit_clicked()
@@ -497,10 +490,11 @@ void Widget::onPushButtonTracking_clicked()
         }
         else
         {
-            targetRect.x = qMin(m_start.x(), m_stop.x()) - frameOrigin.x();
-            targetRect.y = qMin(m_start.y(), m_stop.y()) - frameOrigin.y();
-            targetRect.width = qAbs(m_stop.x() - m_start.x()) + 1;
-            targetRect.height = qAbs(m_stop.y() - m_start.y()) + 1;
+            //框选在缩放后的显示图像上进行, 换算回原帧坐标
+            targetRect.x = cvRound((qMin(m_start.x(), m_stop.x()) - frameOrigin.x()) / frameZoom);
+            targetRect.y = cvRound((qMin(m_start.y(), m_stop.y()) - frameOrigin.y()) / frameZoom);
+            targetRect.width = cvRound((qAbs(m_stop.x() - m_start.x()) + 1) / frameZoom);
+            targetRect.height = cvRound((qAbs(m_stop.y() - m_start.y()) + 1) / frameZoom);
         }
         fsct->initTarget(frameBuf, targetRect);
         hasInitialized = true;
@@ -509,13 +503,20 @@ void Widget::onPushButtonTracking_clicked()
     {
         isTrackingState = true;
         ui->pushButtonTracking->setText(QStringLiteral("停止"));
-        timerTrack->start(1);
+        worker->setup(fsct, &source, targetRect, frameNum, frameCount,
+                      ui->labelFrame->size(), ui->labelGlbApp->size());
+        worker->start();
+        timerTrack->start(15); //界面按约60Hz刷新, 与跟踪速度无关
     }
     else //暂停状态
     {
         isTrackingState = false;
         ui->pushButtonTracking->setText(QStringLiteral("继续"));
+        worker->stop();
+        showTrackingFrame(); //绘制暂停前的最后一帧
         timerTrack->stop();
+        frameNum = worker->getFrameNum();
+        targetRect = worker->getTargetRect();
     }
 }
 
@@ -567,7 +568,7 @@ void Widget::paintEvent(QPaintEvent *)
     }
     else
     {
-        ui->labelFrame->clear();
+        shownImages[ui->labelFrame] = NULL; //框选时帧图像与选框都由本控件绘制
         QRect pg(ui->labelFrame->geometry());
         double xOffset = (ui->labelFrame->contentsRect().width() - frame.width()) / 2;
         double yOffset = (ui->labelFrame->contentsRect().height() - frame.height()) / 2;
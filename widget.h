@@ -5,6 +5,7 @@
 #include <QImage>
 #include <QStringList>
 #include <QList>
+#include <QHash>
 #include <QTimer>
 #include <QLabel>
 #include <QEvent>
@@ -14,6 +15,8 @@
 #include <opencv2/imgcodecs.hpp>
 #include <opencv2/core.hpp>
 #include "corrtrack.h"
+#include "framesource.h"
+#include "trackworker.h"
 
 namespace Ui {
 class Widget;
@@ -31,16 +34,17 @@ private:
     Ui::Widget *ui;
     TrackParam *param;
     CorrTrack *fsct;
+    TrackWorker *worker;
     QTimer *timerPlay;
     QTimer *timerTrack;
-    QTime *time;
-    QImage frame;
-    QImage curApp;
-    QImage glbApp;
+    QImage frame;           //播放时的显示图像
+    cv::Mat playScaleBuf;   //播放时缩放的中间结果
+    double frameZoom;       //播放帧的显示缩放比例
+    QHash<QObject*, const QImage*> shownImages; //各显示控件当前显示的图像, 在eventFilter中直接绘制
 
     QStringList picSeq;
     QList<cv::Rect> groundTruth;
-    cv::VideoCapture video;
+    FrameSource source;
     cv::Mat frameBuf;
 
     cv::Rect targetRect;
@@ -86,10 +90,11 @@ private:
     void mouseMoveEvent(QMouseEvent *e);
     void mouseReleaseEvent(QMouseEvent *e);
     void paintEvent(QPaintEvent *);
-    void showTrackingImage(const cv::Mat& mat, QImage& frame, QLabel *label);
+    bool eventFilter(QObject *obj, QEvent *e);
+    void showTrackingImage(QImage& img, QLabel *label, int index, double zoom);
     void cvRect2QRectF(const cv::Rect& cvrect, QRectF &qrect, double zoom);
-    void showPlayImage(const cv::Mat& mat, QImage& frame, QLabel *label);
-    QImage cvMat2QImage(const cv::Mat& mat);
+    double showPlayImage(const cv::Mat& mat, QImage& frame, QLabel *label);
+    void showImage(const QImage *img, QLabel *label);
 };
 
 #endif // WIDGET_H